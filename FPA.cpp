@@ -24,16 +24,2602 @@ Input: Combined GFE output files in the p mode with per-site annotations.
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
 #include <algorithm>
+#include <string_view>
+#include <charconv>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <set>
+#include <queue>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <time.h>
+#include <sched.h>
+#include <dirent.h>
+#include "FPA_core.h"
 using namespace std;
 
+// Split a line into whitespace-delimited fields, as operator>> would, without copying.
+// The fields point into the line buffer and stay valid until the buffer is overwritten.
+// At most max_fields fields are extracted; missing trailing fields are returned empty.
+static void split_fields(string_view line, vector <string_view> &fields, size_t max_fields)
+{
+	const char *p = line.data();
+	const char *end = p + line.size();
+	size_t nf = 0;
+	while (nf < max_fields) {
+		while ( p < end && isspace((unsigned char)*p) ) {
+			p++;
+		}
+		const char *start = p;
+		while ( p < end && !isspace((unsigned char)*p) ) {
+			p++;
+		}
+		if (nf < fields.size()) {
+			fields[nf] = string_view(start, p - start);
+		} else {
+			fields.push_back( string_view(start, p - start) );
+		}
+		nf++;
+	}
+}
+
+// Parse a floating-point field in place; returns 0.0 when the field is not a number (e.g. NA), as atof does.
+static double parse_double(string_view s)
+{
+	double value = 0.0;
+	if ( from_chars(s.data(), s.data() + s.size(), value).ec != errc() ) {
+		value = 0.0;
+	}
+	return value;
+}
+
+// Parse an integer field in place; returns 0 when the field is not a number.
+static int parse_int(string_view s)
+{
+	int value = 0;
+	if ( from_chars(s.data(), s.data() + s.size(), value).ec != errc() ) {
+		value = 0;
+	}
+	return value;
+}
+
+// Quote a file name for the shell
+static string shell_quote(const char *text)
+{
+	string quoted = "'";
+	for (const char *c = text; *c != '\0'; c++) {
+		if (*c == '\'') {
+			quoted += "'\\''";
+		} else {
+			quoted += *c;
+		}
+	}
+	quoted += "'";
+	return quoted;
+}
+
+// Whether an executable of the given name is found in PATH
+static bool find_program(const char *name)
+{
+	const char *path = getenv("PATH");
+	if (path == NULL) {
+		return false;
+	}
+	string dirs(path);
+	size_t begin = 0;
+	while (begin <= dirs.size()) {
+		size_t end = dirs.find(':', begin);
+		if (end == string::npos) {
+			end = dirs.size();
+		}
+		string dir = dirs.substr(begin, end - begin);
+		string file = (dir.empty() ? string(".") : dir) + "/" + name;
+		if ( access(file.c_str(), X_OK) == 0 ) {
+			return true;
+		}
+		begin = end + 1;
+	}
+	return false;
+}
+
+// Shell command writing the decompressed contents of a compressed file to stdout, judged from the
+// leading bytes of the file.  Returns an empty string when the file is not compressed, and sets
+// missing_tool when no program for its format is installed.  BGZF is decompressed by bgzip with
+// several threads when available; plain gzip by pigz or gzip, on one thread; zstd by pzstd when installed,
+// which decompresses the frames of a multi-frame file (as pzstd writes them) on several threads, else by
+// zstd on one thread, as zstd -T only sets the number of compression threads.
+static string decompress_command(const char *file_name, const unsigned char *head, size_t head_size, int num_threads, const char *&missing_tool)
+{
+	char threads[32];
+	snprintf(threads, sizeof(threads), "%d", (num_threads > 1) ? num_threads : 1);
+	missing_tool = NULL;
+	if (head_size >= 4 && head[0] == 0x28 && head[1] == 0xb5 && head[2] == 0x2f && head[3] == 0xfd) {	// zstd
+		if ( num_threads > 1 && find_program("pzstd") ) {
+			return string("pzstd -d -c -q -p ") + threads + " < " + shell_quote(file_name);
+		}
+		if ( find_program("zstd") ) {
+			return string("zstd -dc -q -- ") + shell_quote(file_name);
+		}
+		missing_tool = "zstd";
+		return string();
+	}
+	if (head_size >= 2 && head[0] == 0x1f && head[1] == 0x8b) {	// gzip
+		bool bgzf = ( head_size >= 14 && (head[3] & 4) && head[12] == 'B' && head[13] == 'C' );
+		if ( bgzf && find_program("bgzip") ) {
+			return string("bgzip -dc -@ ") + threads + " " + shell_quote(file_name);
+		}
+		if ( find_program("pigz") ) {
+			return string("pigz -dc -p ") + threads + " -- " + shell_quote(file_name);
+		}
+		if ( find_program("gzip") ) {
+			return string("gzip -dc -- ") + shell_quote(file_name);
+		}
+		missing_tool = "gzip";
+		return string();
+	}
+	return string();
+}
+
+// Shell command compressing stdin into the output file, chosen by the extension of its name: .gz or .bgz
+// for BGZF written by bgzip (so that the output can be indexed with tabix; gzip is used when bgzip is not
+// installed), .zst for zstd.  Returns an empty
+// string for other names, and sets missing_tool when the compressor is not installed.
+static string compress_command(const char *file_name, int num_threads, const char *&missing_tool)
+{
+	string name(file_name);
+	char threads[32];
+	snprintf(threads, sizeof(threads), "%d", (num_threads > 1) ? num_threads : 1);
+	missing_tool = NULL;
+	if ( (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0) || (name.size() > 4 && name.compare(name.size() - 4, 4, ".bgz") == 0) ) {
+		if ( find_program("bgzip") ) {
+			return string("bgzip -c -@ ") + threads + " > " + shell_quote(file_name);
+		}
+		if ( find_program("pigz") || find_program("gzip") ) {
+			fprintf(stderr, "bgzip is not found in PATH; %s is written as plain gzip, which cannot be indexed.\n", file_name);
+			return find_program("pigz") ? string("pigz -c -p ") + threads + " > " + shell_quote(file_name) : string("gzip -c > ") + shell_quote(file_name);
+		}
+		missing_tool = "bgzip";
+		return string();
+	}
+	if ( name.size() > 4 && name.compare(name.size() - 4, 4, ".zst") == 0 ) {
+		if ( find_program("zstd") ) {
+			return string("zstd -c -q -T") + threads + " > " + shell_quote(file_name);
+		}
+		missing_tool = "zstd";
+		return string();
+	}
+	return string();
+}
+
+// Binary columnar input written by -convert; see write_binary_block for the layout
+static const char BINARY_MAGIC[8] = {'F', 'P', 'A', 'B', 'I', 'N', '0', '1'};
+
+static inline size_t pad8(size_t n)
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+// Header labels accepted for each population column, after removing a population suffix such as _1
+static const struct {
+	const char *label;
+	PopColumn column;
+} column_aliases[] = {
+	{"major_allele", COL_N1}, {"n1", COL_N1},
+	{"minor_allele", COL_N2}, {"n2", COL_N2},
+	{"pop_coverage", COL_COV}, {"coverage", COL_COV}, {"cov", COL_COV},
+	{"Nc", COL_NC},
+	{"best_p", COL_P}, {"p", COL_P},
+	{"best_q", COL_Q}, {"q", COL_Q},
+	{"pol_llstat", COL_POL_LLSTAT}, {"llstat", COL_POL_LLSTAT},
+};
+
+// Label of a population column without a population suffix: _<name> or .<name> after one of the accepted
+// labels, where the name may itself end in digits (major_allele_Kenya_1 is major_allele for Kenya_1).  A bare
+// _<number> or .<number> is removed only when what is left is an accepted label.
+static string column_label(const string &label)
+{
+	size_t longest = 0;
+	for (size_t ag = 0; ag < sizeof(column_aliases)/sizeof(column_aliases[0]); ag++) {
+		size_t len = strlen(column_aliases[ag].label);
+		if ( len > longest && label.size() > len + 1 && label.compare(0, len, column_aliases[ag].label) == 0 && (label[len] == '_' || label[len] == '.') ) {
+			longest = len;
+		}
+	}
+	if (longest > 0) {
+		return label.substr(0, longest);
+	}
+	size_t end = label.size();
+	while ( end > 0 && isdigit((unsigned char)label[end-1]) ) {
+		end--;
+	}
+	if ( end < label.size() && end > 1 && (label[end-1] == '_' || label[end-1] == '.') ) {
+		string stem = label.substr(0, end - 1);
+		for (size_t ag = 0; ag < sizeof(column_aliases)/sizeof(column_aliases[0]); ag++) {
+			if (stem == column_aliases[ag].label) {
+				return stem;
+			}
+		}
+	}
+	return label;
+}
+
+// Name of each population of the input: the suffix of the label of its major-allele column (e.g. Kenya for
+// major_allele_Kenya), or empty when the label has none
+static vector <string> population_names(const vector <string> &labels, const ColumnMap &map)
+{
+	vector <string> names;
+	for (int k = 0; k < map.input_pops; k++) {
+		const string &label = labels[k*map.pop_width + map.offset[COL_N1]];
+		size_t len = column_label(label).size();
+		names.push_back( (label.size() > len + 1) ? label.substr(len + 1) : string() );
+	}
+	return names;
+}
+
+// Find the ids of the populations given by name or by number (from 1) in a list separated by commas or
+// whitespace.  Returns false when an entry matches no population.
+static bool parse_populations(const string &list, const vector <string> &names, vector <int> &ids, string &unknown)
+{
+	vector <bool> selected(names.size(), false);
+	size_t pos = 0;
+	while (pos < list.size()) {
+		size_t end = list.find_first_of(", \t\r\n", pos);
+		if (end == string::npos) {
+			end = list.size();
+		}
+		string entry = list.substr(pos, end - pos);
+		pos = end + 1;
+		if ( entry.empty() ) {
+			continue;
+		}
+		size_t kg = find(names.begin(), names.end(), entry) - names.begin();
+		if (kg == names.size() && entry.find_first_not_of("0123456789") == string::npos) {
+			kg = (size_t)atoi(entry.c_str()) - 1;
+		}
+		if (kg >= names.size()) {
+			unknown = entry;
+			return false;
+		}
+		selected[kg] = true;
+	}
+	ids.clear();
+	for (size_t kg = 0; kg < names.size(); kg++) {
+		if (selected[kg]) {
+			ids.push_back((int)kg + 1);
+		}
+	}
+	return true;
+}
+
+// Build the column map from the labels of the population columns of the header.  The block of columns of
+// a population ends where the label of its first column repeats, so that variants with extra annotation
+// columns are accepted in any order.  When a used column is not found, the nine GFE columns are assumed,
+// as in earlier versions.  Returns false in that case.
+static bool build_column_map(const vector <string> &labels, int &num_pops, ColumnMap &map)
+{
+	vector <string> names;
+	for (size_t ig = 0; ig < labels.size(); ig++) {
+		names.push_back( column_label(labels[ig]) );
+	}
+	size_t width = 1;
+	while ( width < names.size() && names[width] != names[0] ) {
+		width++;
+	}
+	bool found[NUM_POP_COLUMNS] = {false};
+	for (size_t jg = 0; jg < width && jg < names.size(); jg++) {
+		for (size_t ag = 0; ag < sizeof(column_aliases)/sizeof(column_aliases[0]); ag++) {
+			PopColumn column = column_aliases[ag].column;
+			if ( !found[column] && names[jg] == column_aliases[ag].label ) {
+				found[column] = true;
+				map.offset[column] = jg;
+			}
+		}
+	}
+	for (int cg = 0; cg < NUM_POP_COLUMNS; cg++) {
+		if (!found[cg]) {
+			num_pops = (int)labels.size()/9;
+			map = gfe_column_map(num_pops);
+			return false;
+		}
+	}
+	num_pops = (int)(labels.size()/width);
+	map.pop_width = width;
+	map.input_pops = num_pops;
+	vector <int> ids;
+	for (int k = 0; k < num_pops; k++) {
+		ids.push_back(k + 1);
+	}
+	select_populations(map, ids);
+	return true;
+}
+
+// Line reader for the input file.  Regular files are memory-mapped and walked directly out of the
+// page cache; pipes and other inputs that cannot be mapped are read as a stream.  Files compressed
+// with gzip, bgzip or zstd are read as a stream from a decompressing child process.  Binary columnar
+// files made by -convert are always mapped; they hold the header line and blocks of sites instead of lines.
+// Per-population GFE files given to open_merged are merged into the lines of a combined file; they are read
+// one after another by the thread reading the input, and only their decompression runs in other processes.
+class InputReader {
+public:
+	InputReader() : fd(-1), map_data(NULL), map_size(0), pos(0), end_pos(0), stream(NULL), piped(false), buf(NULL), buf_cap(0), regular(false), binary(false), merged(false), header_served(false), corrupt(false) {}
+	~InputReader() { close(); }
+
+	// Open per-population GFE p-mode files, each with the columns of one population after scaffold, site and
+	// ref_nuc, and merge them on (scaffold, site) as a combined file.  The populations are numbered in the
+	// order of the files, and their header labels get the name of the file (up to its first dot) as a suffix.
+	// A population without a line for a site gets NA estimates and zero coverage, also for a whole scaffold
+	// missing from its file.  The files must list the scaffolds they have in the same order, each scaffold in
+	// one run of lines with the sites in increasing order.  When every file is mapped, the order of the
+	// scaffolds is taken from all of them before merging; otherwise the next scaffold is the one most files
+	// are on.  A file that goes back to a scaffold already merged, or down in site, stops the run with an
+	// error.  Each file is read ahead in chunks.  Returns false on failure.
+	bool open_merged(const vector <string> &file_names, bool use_mmap)
+	{
+		merged = true;
+		regular = false;
+		pos = 0;
+		end_pos = UINT64_MAX;
+		merge_header = "scaffold\tsite\tref_nuc";
+		size_t width = 0;
+		sources.reserve( file_names.size() );	// lines of the sources may point into their storage
+		vector < vector <string> > runs;	// scaffolds of the mapped files, once for each run of lines
+		for (size_t fg = 0; fg < file_names.size(); fg++) {
+			sources.push_back( MergeSource() );
+			MergeSource &src = sources.back();
+			src.file_name = file_names[fg];
+			src.reader.reset(new InputReader);
+			string_view header;
+			if ( !src.reader->open(file_names[fg].c_str(), use_mmap) || !src.reader->next_line(header) ) {
+				fprintf(stderr, "Cannot open %s for reading.\n", file_names[fg].c_str());
+				return false;
+			}
+			// Labels of the population columns, suffixed with the name of the file
+			istringstream ss{string(header)};
+			string label, name = file_names[fg].substr(file_names[fg].find_last_of('/') + 1);
+			name = name.substr(0, name.find('.'));
+			vector <string> labels;
+			for (int hg = 0; ss >> label; hg++) {
+				if (hg >= 3) {
+					labels.push_back(label);
+					merge_header += "\t" + label + "_" + name;
+				}
+			}
+			if (fg == 0) {
+				width = labels.size();
+			} else if (labels.size() != width) {
+				fprintf(stderr, "%s does not have the %zu population columns of %s.\n", file_names[fg].c_str(), width, file_names[0].c_str());
+				return false;
+			}
+			// Columns of a population without data: NA, except for zero coverage
+			int num_pops;
+			ColumnMap map;
+			build_column_map(labels, num_pops, map);
+			for (size_t cg = 0; cg < width; cg++) {
+				src.missing += (cg == map.offset[COL_COV]) ? "\t0" : "\tNA";
+			}
+			if ( src.reader->is_mapped() && runs.size() == fg ) {
+				runs.push_back( vector <string>() );
+				src.reader->scaffold_runs( runs.back() );
+			}
+			advance(src);
+		}
+		if ( runs.size() == sources.size() && !order_scaffolds(runs) ) {
+			return false;
+		}
+		return true;
+	}
+
+	// Open the file; memory mapping is attempted only when use_mmap is set, and compressed files are
+	// decompressed with up to num_threads threads.  Returns false on failure.
+	bool open(const char *file_name, bool use_mmap, int num_threads = 1)
+	{
+		fd = (strcmp(file_name, "-") == 0) ? dup(STDIN_FILENO) : ::open(file_name, O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat st;
+		regular = ( fstat(fd, &st) == 0 && S_ISREG(st.st_mode) );
+		file_size = regular ? (uint64_t)st.st_size : 0;
+		mod_time = regular ? (int64_t)st.st_mtime : 0;
+		end_pos = regular ? file_size : UINT64_MAX;
+		if (regular) {	// Check for a compressed file
+			unsigned char head[16];
+			ssize_t head_size = pread(fd, head, sizeof(head), 0);
+			const char *missing_tool;
+			string command = decompress_command(file_name, head, (head_size > 0) ? (size_t)head_size : 0, num_threads, missing_tool);
+			if (missing_tool != NULL) {
+				fprintf(stderr, "%s is compressed, but %s is not found in PATH.\n", file_name, missing_tool);
+				::close(fd);
+				fd = -1;
+				return false;
+			}
+			if ( head_size >= 16 && memcmp(head, BINARY_MAGIC, 8) == 0 ) {
+				return open_binary(head);
+			}
+			if ( !command.empty() ) {
+				::close(fd);
+				fd = -1;
+				stream = popen(command.c_str(), "r");
+				if (stream == NULL) {
+					return false;
+				}
+				piped = true;
+				regular = false;	// the decompressed stream cannot be repositioned
+				end_pos = UINT64_MAX;
+				return true;
+			}
+		}
+		if ( use_mmap && regular && file_size > 0 ) {
+			void *addr = mmap(NULL, (size_t)file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr != MAP_FAILED) {
+				map_data = (const char *)addr;
+				map_size = (size_t)file_size;
+				madvise(addr, map_size, MADV_SEQUENTIAL);
+				return true;
+			}
+		}
+		// Fall back to streaming
+		stream = fdopen(fd, "r");
+		if (stream == NULL) {
+			::close(fd);
+			fd = -1;
+			return false;
+		}
+		return true;
+	}
+
+	// Get the next line without its newline; the line stays valid until the next call.
+	bool next_line(string_view &line)
+	{
+		if (merged) {	// The header, then one merged line at a time
+			if (!header_served) {
+				header_served = true;
+				line = merge_header;
+				return true;
+			}
+			merge_buf.clear();
+			if ( !merge_line(merge_buf) ) {
+				return false;
+			}
+			line = string_view(merge_buf.data(), merge_buf.size() - 1);
+			return true;
+		}
+		if (binary) {	// The only line of a binary file is its header
+			if (header_served) {
+				return false;
+			}
+			line = binary_header;
+			header_served = true;
+			return true;
+		}
+		if (pos >= end_pos) {
+			return false;
+		}
+		if (map_data != NULL) {
+			const char *start = map_data + pos;
+			const char *nl = (const char *)memchr(start, '\n', end_pos - pos);
+			size_t len = (nl != NULL) ? (size_t)(nl - start) : end_pos - pos;
+			line = string_view(start, len);
+			pos = pos + len + 1;
+			return true;
+		}
+		ssize_t len = ::getline(&buf, &buf_cap, stream);
+		if (len < 0) {
+			return false;
+		}
+		pos = pos + len;
+		if (len > 0 && buf[len-1] == '\n') {
+			len--;
+		}
+		line = string_view(buf, (size_t)len);
+		return true;
+	}
+
+	// Get a chunk of whole lines of about chunk_bytes bytes.  Lines of a mapped file are returned in place;
+	// streamed input is copied into storage, which the caller keeps alive while the chunk is in use.
+	bool next_chunk(size_t chunk_bytes, string_view &chunk, string &storage)
+	{
+		if (merged) {	// Merged lines of the per-population files
+			storage.clear();
+			while ( storage.size() < chunk_bytes && merge_line(storage) ) {
+			}
+			pos = pos + storage.size();
+			chunk = string_view(storage);
+			return !storage.empty();
+		}
+		if (binary) {	// Whole blocks of a binary file
+			uint64_t begin = pos;
+			while (pos < end_pos && pos - begin < chunk_bytes) {
+				uint64_t block_bytes;
+				memcpy(&block_bytes, map_data + pos, sizeof(block_bytes));
+				if ( block_bytes < 8 || block_bytes > end_pos - pos || (block_bytes & 7) ) {
+					corrupt = true;
+					pos = end_pos;
+					return false;
+				}
+				pos = pos + block_bytes;
+			}
+			if (pos == begin) {
+				return false;
+			}
+			chunk = string_view(map_data + begin, pos - begin);
+			return true;
+		}
+		if (map_data != NULL) {
+			if (pos >= end_pos) {
+				return false;
+			}
+			uint64_t end = pos + chunk_bytes;
+			if (end >= end_pos) {
+				end = end_pos;
+			} else {	// Extend the chunk to the end of the line
+				const char *nl = (const char *)memchr(map_data + end, '\n', end_pos - end);
+				end = (nl != NULL) ? (uint64_t)(nl - map_data) + 1 : end_pos;
+			}
+			chunk = string_view(map_data + pos, end - pos);
+			pos = end;
+			return true;
+		}
+		storage.assign(carry);
+		carry.clear();
+		while (true) {
+			size_t filled = storage.size();
+			size_t request = chunk_bytes;
+			if (end_pos - pos < request) {
+				request = (size_t)(end_pos - pos);
+			}
+			storage.resize(filled + request);
+			size_t n = (request > 0) ? fread(&storage[filled], 1, request, stream) : 0;
+			storage.resize(filled + n);
+			pos = pos + n;
+			if (n < chunk_bytes) {	// End of the input: the rest forms the last chunk
+				break;
+			}
+			size_t last_nl = storage.rfind('\n');
+			if (last_nl != string::npos) {	// Keep the partial last line for the next chunk
+				carry.assign(storage, last_nl + 1, string::npos);
+				storage.resize(last_nl + 1);
+				break;
+			}
+		}
+		if ( storage.empty() ) {
+			return false;
+		}
+		chunk = string_view(storage);
+		return true;
+	}
+
+	// Restrict reading to the byte range [begin, end) of the file, which must start at a line boundary.
+	// Only regular files can be repositioned.
+	bool set_range(uint64_t begin, uint64_t end)
+	{
+		if (!regular) {
+			return false;
+		}
+		if (end > file_size) {
+			end = file_size;
+		}
+		if (stream != NULL && fseeko(stream, (off_t)begin, SEEK_SET) != 0) {
+			return false;
+		}
+		carry.clear();
+		pos = begin;
+		end_pos = (begin < end) ? end : begin;
+		return true;
+	}
+
+	bool is_mapped() const { return map_data != NULL; }
+	bool is_regular() const { return regular; }
+	uint64_t size() const { return file_size; }
+	int64_t mtime() const { return mod_time; }
+	uint64_t offset() const { return pos - carry.size(); }	// offset of the next unread line
+	uint64_t end_offset() const { return end_pos; }	// offset at which reading stops
+
+	bool is_compressed() const { return piped; }
+	bool is_binary() const { return binary; }
+
+	// Close the input; returns false when reading failed, e.g. when decompression reported an error
+	bool close()
+	{
+		bool ok = !corrupt;
+		for (size_t fg = 0; fg < sources.size(); fg++) {
+			ok = sources[fg].reader->close() && ok;
+		}
+		sources.clear();
+		merged = false;
+		if (map_data != NULL) {
+			munmap((void *)map_data, map_size);
+			map_data = NULL;
+			::close(fd);
+		} else if (stream != NULL) {
+			ok = !ferror(stream);
+			if (piped) {
+				ok = (pclose(stream) == 0) && ok;
+			} else {
+				fclose(stream);	// also closes fd
+			}
+			stream = NULL;
+		}
+		piped = false;
+		binary = false;
+		corrupt = false;
+		fd = -1;
+		free(buf);
+		buf = NULL;
+		buf_cap = 0;
+		return ok;
+	}
+
+private:
+	// A per-population file being merged, positioned on its next line
+	struct MergeSource {
+		unique_ptr <InputReader> reader;
+		string_view chunk;	// lines read ahead
+		string storage;
+		size_t chunk_pos;	// offset of the next line in chunk
+		bool has_line;		// whether the fields below hold a line; false at the end of the file
+		string_view scaffold, ref_nuc, columns;	// scaffold, ref_nuc and the population columns with their leading tabs
+		int site;
+		string missing;		// population columns of a site missing from the file
+		string file_name;
+		string last_scaffold;	// scaffold and site of the last line, to check the order of the file
+		int last_site;
+
+		MergeSource() : chunk_pos(0), has_line(false), site(0), last_site(0) {}
+	};
+
+	// Scaffolds of the lines of a mapped file from the current position, once for each run of lines
+	void scaffold_runs(vector <string> &runs) const
+	{
+		vector <string_view> fields;
+		const char *p = map_data + pos, *end = map_data + end_pos;
+		while (p < end) {
+			const char *nl = (const char *)memchr(p, '\n', end - p);
+			const char *line_end = (nl != NULL) ? nl : end;
+			split_fields(string_view(p, line_end - p), fields, 1);
+			if ( !fields[0].empty() && (runs.empty() || runs.back() != fields[0]) ) {
+				runs.push_back( string(fields[0]) );
+			}
+			p = line_end + 1;
+		}
+	}
+
+	// Rank the scaffolds of all the files so that each file lists its scaffolds in the order of their ranks;
+	// where the files leave the order open, scaffolds seen first in the files come first.  Returns false
+	// when no such order exists.
+	bool order_scaffolds(const vector < vector <string> > &runs)
+	{
+		map <string, size_t, less <> > id;	// scaffolds by first appearance
+		vector <const string *> names;
+		vector < vector <size_t> > after;	// scaffolds that follow each one in some file
+		vector <size_t> num_before;
+		for (size_t fg = 0; fg < runs.size(); fg++) {
+			for (size_t rg = 0; rg < runs[fg].size(); rg++) {
+				auto ins = id.insert( make_pair(runs[fg][rg], names.size()) );
+				if (ins.second) {
+					names.push_back( &ins.first->first );
+					after.push_back( vector <size_t>() );
+					num_before.push_back(0);
+				}
+				if (rg > 0) {
+					after[ id.find(runs[fg][rg - 1])->second ].push_back(ins.first->second);
+					num_before[ins.first->second]++;
+				}
+			}
+		}
+		priority_queue < size_t, vector <size_t>, greater <size_t> > ready;
+		for (size_t ig = 0; ig < names.size(); ig++) {
+			if (num_before[ig] == 0) {
+				ready.push(ig);
+			}
+		}
+		scaffold_rank.clear();
+		while ( !ready.empty() ) {
+			size_t ig = ready.top();
+			ready.pop();
+			size_t rank = scaffold_rank.size();
+			scaffold_rank[*names[ig]] = rank;
+			for (size_t jg = 0; jg < after[ig].size(); jg++) {
+				if (--num_before[ after[ig][jg] ] == 0) {
+					ready.push( after[ig][jg] );
+				}
+			}
+		}
+		if ( scaffold_rank.size() != names.size() ) {
+			fprintf(stderr, "The per-population files list their scaffolds in different orders, or a file lists a scaffold in more than one run of lines.\n");
+			return false;
+		}
+		return true;
+	}
+
+	// Move a source to its next non-empty line
+	void advance(MergeSource &src)
+	{
+		src.has_line = false;
+		while (true) {
+			if (src.chunk_pos >= src.chunk.size()) {
+				if ( !src.reader->next_chunk((size_t)1 << 20, src.chunk, src.storage) ) {
+					return;
+				}
+				src.chunk_pos = 0;
+			}
+			const char *start = src.chunk.data() + src.chunk_pos;
+			const char *nl = (const char *)memchr(start, '\n', src.chunk.size() - src.chunk_pos);
+			size_t len = (nl != NULL) ? (size_t)(nl - start) : src.chunk.size() - src.chunk_pos;
+			src.chunk_pos = src.chunk_pos + len + 1;
+			string_view line(start, len);
+			split_fields(line, merge_fields, 3);
+			if ( merge_fields[0].empty() ) {
+				continue;
+			}
+			src.scaffold = merge_fields[0];
+			src.site = parse_int(merge_fields[1]);
+			src.ref_nuc = merge_fields[2];
+			if (src.scaffold != src.last_scaffold) {
+				if ( merged_scaffolds.find(src.scaffold) != merged_scaffolds.end() && src.scaffold != merge_scaffold ) {
+					fprintf(stderr, "%s lists scaffold %s after the other files have moved past it; the files must list their scaffolds in the same order.\n", src.file_name.c_str(), string(src.scaffold).c_str());
+					exit(1);
+				}
+				src.last_scaffold.assign(src.scaffold.data(), src.scaffold.size());
+			} else if (src.site <= src.last_site) {
+				fprintf(stderr, "%s does not list the sites of scaffold %s in increasing order (site %d after %d).\n", src.file_name.c_str(), src.last_scaffold.c_str(), src.site, src.last_site);
+				exit(1);
+			}
+			src.last_site = src.site;
+			size_t columns_begin = merge_fields[2].data() + merge_fields[2].size() - line.data();
+			src.columns = line.substr(columns_begin);
+			if ( !src.columns.empty() && src.columns.back() == '\r' ) {
+				src.columns.remove_suffix(1);
+			}
+			src.has_line = true;
+			return;
+		}
+	}
+
+	// Append the next merged line, with its newline, to out; returns false when all files are read.  The
+	// current scaffold continues while any file is on it; then the next one is the scaffold of lowest rank
+	// that a file is on or, without ranks, the one most files are on (of the first such file on a tie).
+	// The site is the lowest of the current scaffold among the files.
+	bool merge_line(string &out)
+	{
+		bool on_scaffold = false;
+		for (size_t fg = 0; fg < sources.size() && !on_scaffold; fg++) {
+			on_scaffold = sources[fg].has_line && sources[fg].scaffold == merge_scaffold;
+		}
+		if (!on_scaffold) {
+			size_t next = sources.size(), best = 0;
+			for (size_t fg = 0; fg < sources.size(); fg++) {
+				if (!sources[fg].has_line) {
+					continue;
+				}
+				size_t score;	// lower is better
+				if ( !scaffold_rank.empty() ) {
+					score = scaffold_rank.find(sources[fg].scaffold)->second;
+				} else {
+					score = sources.size();
+					for (size_t gg = 0; gg < sources.size(); gg++) {
+						score -= ( sources[gg].has_line && sources[gg].scaffold == sources[fg].scaffold );
+					}
+				}
+				if (next == sources.size() || score < best) {
+					next = fg;
+					best = score;
+				}
+			}
+			if ( next == sources.size() ) {
+				return false;
+			}
+			merge_scaffold.assign(sources[next].scaffold.data(), sources[next].scaffold.size());
+			merged_scaffolds.insert(merge_scaffold);
+		}
+		int site = INT_MAX;
+		size_t first = sources.size();
+		for (size_t fg = 0; fg < sources.size(); fg++) {
+			if ( sources[fg].has_line && sources[fg].scaffold == merge_scaffold && sources[fg].site < site ) {
+				site = sources[fg].site;
+				first = fg;
+			}
+		}
+		out.append(merge_scaffold);
+		out.push_back('\t');
+		out.append( to_string(site) );
+		out.push_back('\t');
+		out.append(sources[first].ref_nuc);
+		for (size_t fg = 0; fg < sources.size(); fg++) {
+			MergeSource &src = sources[fg];
+			if ( src.has_line && src.site == site && src.scaffold == merge_scaffold ) {
+				out.append(src.columns);
+				advance(src);
+			} else {
+				out.append(src.missing);
+			}
+		}
+		out.push_back('\n');
+		return true;
+	}
+
+	// Map a binary columnar file: magic, number of populations, length of the header line, header line, blocks
+	bool open_binary(const unsigned char *head)
+	{
+		uint32_t header_len;
+		memcpy(&header_len, head + 12, sizeof(header_len));
+		void *addr = mmap(NULL, (size_t)file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED || 16 + (uint64_t)header_len > file_size) {
+			fprintf(stderr, "Cannot map the binary input file.\n");
+			if (addr != MAP_FAILED) {
+				munmap(addr, (size_t)file_size);
+			}
+			::close(fd);
+			fd = -1;
+			return false;
+		}
+		map_data = (const char *)addr;
+		map_size = (size_t)file_size;
+		madvise(addr, map_size, MADV_SEQUENTIAL);
+		binary = true;
+		binary_header = string_view(map_data + 16, header_len);
+		pos = pad8(16 + (size_t)header_len);
+		return true;
+	}
+
+	int fd;
+	const char *map_data;	// memory-mapped file contents
+	size_t map_size;
+	uint64_t pos;		// offset of the next byte to be read
+	uint64_t end_pos;	// offset at which reading stops
+	FILE *stream;		// stream used when the file is not mapped
+	bool piped;		// whether stream is the output of a decompressing process
+	char *buf;		// line buffer of the stream, reused across lines
+	size_t buf_cap;
+	string carry;		// partial line left over from the previous streamed chunk
+	bool regular;		// whether the input is a regular file
+	bool binary;		// whether the input is a binary columnar file
+	string_view binary_header;	// header line stored in the binary file
+	bool merged;		// whether the input is merged from per-population files
+	vector <MergeSource> sources;	// per-population files, in population order
+	string merge_header;	// header of the merged input
+	string merge_scaffold;	// scaffold of the last merged line
+	set <string, less <> > merged_scaffolds;	// scaffolds merged so far, the current one included
+	map <string, size_t, less <> > scaffold_rank;	// order of the scaffolds when every file is mapped
+	string merge_buf;	// last line returned by next_line
+	vector <string_view> merge_fields;
+	bool header_served;
+	bool corrupt;		// a malformed block was found in the binary file
+	uint64_t file_size;
+	int64_t mod_time;
+};
+
+// Entry of the scaffold index: a run of consecutive lines of one scaffold
+struct IndexEntry {
+	string scaffold;
+	uint64_t begin;		// byte offset of the first line
+	uint64_t end;		// byte offset just past the last line
+	int first_site;
+	int last_site;
+};
+
+// Build the scaffold index by scanning the lines after the header
+static void build_index(InputReader &reader, vector <IndexEntry> &index)
+{
+	string_view line;
+	uint64_t line_begin = reader.offset();
+	index.clear();
+	while ( reader.next_line(line) ) {
+		size_t tab = 0;
+		while ( tab < line.size() && !isspace((unsigned char)line[tab]) ) {
+			tab++;
+		}
+		string_view scaffold = line.substr(0, tab);
+		size_t site_begin = tab;
+		while ( site_begin < line.size() && isspace((unsigned char)line[site_begin]) ) {
+			site_begin++;
+		}
+		int site = parse_int( line.substr(site_begin) );
+		if ( index.empty() || index.back().scaffold != scaffold ) {
+			IndexEntry entry;
+			entry.scaffold = string(scaffold);
+			entry.begin = line_begin;
+			entry.first_site = site;
+			index.push_back(entry);
+		}
+		index.back().last_site = site;
+		index.back().end = reader.offset();
+		line_begin = reader.offset();
+	}
+}
+
+// Write the scaffold index.  The first line records the size and modification time of the input,
+// so that an index of a file that has since changed is not used.
+static bool write_index(const char *index_file_name, const vector <IndexEntry> &index, uint64_t in_size, int64_t in_mtime)
+{
+	FILE *indexstream = fopen(index_file_name, "w");
+	if (indexstream == NULL) {
+		return false;
+	}
+	fprintf(indexstream, "#FPA_index\t%llu\t%lld\n", (unsigned long long)in_size, (long long)in_mtime);
+	for (size_t ig = 0; ig < index.size(); ig++) {
+		fprintf(indexstream, "%s\t%llu\t%llu\t%d\t%d\n", index[ig].scaffold.c_str(), (unsigned long long)index[ig].begin, (unsigned long long)index[ig].end, index[ig].first_site, index[ig].last_site);
+	}
+	return fclose(indexstream) == 0;
+}
+
+// Read the scaffold index; returns false when it is missing or does not match the input
+static bool read_index(const char *index_file_name, vector <IndexEntry> &index, uint64_t in_size, int64_t in_mtime)
+{
+	ifstream indexFile(index_file_name);
+	if ( !indexFile.is_open() ) {
+		return false;
+	}
+	string line, tag;
+	unsigned long long size;
+	long long mtime;
+	if ( !getline(indexFile, line) ) {
+		return false;
+	}
+	istringstream hs(line);
+	if ( !(hs >> tag >> size >> mtime) || tag != "#FPA_index" || size != in_size || mtime != in_mtime ) {
+		return false;
+	}
+	index.clear();
+	while ( getline(indexFile, line) ) {
+		istringstream ss(line);
+		IndexEntry entry;
+		unsigned long long begin, end;
+		if ( !(ss >> entry.scaffold >> begin >> end >> entry.first_site >> entry.last_site) ) {
+			return false;
+		}
+		entry.begin = begin;
+		entry.end = end;
+		index.push_back(entry);
+	}
+	return true;
+}
+
+// Get the scaffold index of a text input file from index_name, or build it and save it there on the first use
+static void load_index(const char *in_file_name, const string &index_name, const InputReader &inputFile, vector <IndexEntry> &index)
+{
+	if ( read_index(index_name.c_str(), index, inputFile.size(), inputFile.mtime()) ) {
+		return;
+	}
+	InputReader indexInput;
+	string_view header;
+	if ( !indexInput.open(in_file_name, true) ) {
+		fprintf(stderr, "Cannot open %s for reading.\n", in_file_name);
+		exit(1);
+	}
+	indexInput.next_line(header);
+	build_index(indexInput, index);
+	if ( !write_index(index_name.c_str(), index, inputFile.size(), inputFile.mtime()) ) {
+		fprintf(stderr, "Cannot write the index %s; continuing without saving it.\n", index_name.c_str());
+	}
+}
+
+// Parse a region given as scaffold[:start[-end]]; returns false on a malformed range
+static bool parse_region(const char *region, string &scaffold, int &start, int &end)
+{
+	string text(region);
+	start = 0;
+	end = INT_MAX;
+	size_t colon = text.rfind(':');
+	if (colon == string::npos) {
+		scaffold = text;
+		return !scaffold.empty();
+	}
+	scaffold = text.substr(0, colon);
+	string range = text.substr(colon + 1);
+	char tail;
+	if ( sscanf(range.c_str(), "%d-%d%c", &start, &end, &tail) == 2 ) {
+		return !scaffold.empty() && start <= end;
+	}
+	if ( sscanf(range.c_str(), "%d%c", &start, &tail) == 1 || sscanf(range.c_str(), "%d-%c", &start, &tail) == 1 ) {
+		end = INT_MAX;
+		return !scaffold.empty();
+	}
+	return false;
+}
+
+// Combinations of the analysis settings evaluated in a single pass over the input.  Each combination
+// writes its own output; the input is parsed once with the lowest min_Nc of the combinations.
+struct FPASweep {
+	FPAConfig parse;		// settings used when parsing
+	vector <FPAConfig> combos;	// settings of each combination
+	bool summarize;			// whether the private alleles are summarized for -summary
+
+	FPASweep() : summarize(false) {}
+};
+
+const size_t BINARY_BLOCK_SIZE = 4096;	// maximum number of sites in a block of the binary format
+
+// Block of sites of one scaffold in a binary columnar file.  Its layout, with every part padded to a
+// multiple of 8 bytes, is
+//	uint64 size of the block in bytes, uint32 number of sites n, uint32 length of the scaffold name,
+//	int32 first site, int32 last site, scaffold name,
+//	int32 site[n], uint32 offsets of the reference nucleotides[n+1], reference nucleotides,
+//	uint8 n1[n*num_pops], uint8 n2[n*num_pops], int32 coverage[n*num_pops],
+//	double Nc[n*num_pops], double p[n*num_pops], double q[n*num_pops], double pol_llstat[n*num_pops]
+// where the population columns are laid out as in SiteBatch.  Numbers are in the byte order of the machine.
+// Frequencies are stored as double, so an analysis of the binary file gives the same output as of the text.
+struct BinaryBlock {
+	uint64_t block_bytes;
+	uint32_t num_sites;
+	string_view scaffold;
+	int first_site, last_site;
+	const int32_t *site;
+	const uint32_t *ref_offset;
+	const char *ref_bytes;
+	const unsigned char *n1, *n2;
+	const int32_t *cov;
+	const double *Nc, *p, *q, *pol_llstat;
+};
+
+static void write_padded(string &out, const void *data, size_t n)
+{
+	out.append((const char *)data, n);
+	out.append(pad8(n) - n, '\0');
+}
+
+// Append sites [begin, end) of the batch, all of one scaffold, to out as a block
+static void write_binary_block(string &out, const SiteBatch &batch, size_t begin, size_t end)
+{
+	const size_t num_pops = batch.num_pops;
+	const uint32_t n = (uint32_t)(end - begin);
+	const size_t nv = n*num_pops;
+	const size_t row = begin*num_pops;
+	size_t start = out.size();
+	uint64_t block_bytes = 0;	// filled in at the end
+	uint32_t scaffold_len = (uint32_t)batch.scaffold[begin].size();
+	int32_t first_site = batch.site[begin], last_site = batch.site[end-1];
+	out.append((const char *)&block_bytes, 8);
+	out.append((const char *)&n, 4);
+	out.append((const char *)&scaffold_len, 4);
+	out.append((const char *)&first_site, 4);
+	out.append((const char *)&last_site, 4);
+	write_padded(out, batch.scaffold[begin].data(), scaffold_len);
+	write_padded(out, &batch.site[begin], 4*(size_t)n);
+	string refs;
+	vector <uint32_t> ref_offset(1, 0);
+	for (size_t sg = begin; sg < end; sg++) {
+		refs.append(batch.ref_nuc[sg]);
+		ref_offset.push_back( (uint32_t)refs.size() );
+	}
+	write_padded(out, ref_offset.data(), 4*ref_offset.size());
+	write_padded(out, refs.data(), refs.size());
+	write_padded(out, &batch.n1[row], nv);
+	write_padded(out, &batch.n2[row], nv);
+	write_padded(out, &batch.cov[row], 4*nv);
+	write_padded(out, &batch.Nc[row], 8*nv);
+	write_padded(out, &batch.p[row], 8*nv);
+	write_padded(out, &batch.q[row], 8*nv);
+	write_padded(out, &batch.pol_llstat[row], 8*nv);
+	block_bytes = out.size() - start;
+	memcpy(&out[start], &block_bytes, 8);
+}
+
+// Locate the columns of the block at the start of data; returns false if the block is malformed
+static bool decode_binary_block(string_view data, size_t num_pops, BinaryBlock &block)
+{
+	if (data.size() < 24) {
+		return false;
+	}
+	const char *base = data.data();
+	uint32_t scaffold_len;
+	int32_t first_site, last_site;
+	memcpy(&block.block_bytes, base, 8);
+	memcpy(&block.num_sites, base + 8, 4);
+	memcpy(&scaffold_len, base + 12, 4);
+	memcpy(&first_site, base + 16, 4);
+	memcpy(&last_site, base + 20, 4);
+	if (block.block_bytes > data.size()) {
+		return false;
+	}
+	const size_t n = block.num_sites;
+	const size_t nv = n*num_pops;
+	size_t offset = 24;
+	block.scaffold = string_view(base + offset, scaffold_len);
+	offset += pad8(scaffold_len);
+	block.first_site = first_site;
+	block.last_site = last_site;
+	block.site = (const int32_t *)(base + offset);
+	offset += pad8(4*n);
+	block.ref_offset = (const uint32_t *)(base + offset);
+	offset += pad8(4*(n+1));
+	if (offset > block.block_bytes) {
+		return false;
+	}
+	block.ref_bytes = base + offset;
+	offset += pad8(block.ref_offset[n]);
+	block.n1 = (const unsigned char *)(base + offset);
+	offset += pad8(nv);
+	block.n2 = (const unsigned char *)(base + offset);
+	offset += pad8(nv);
+	block.cov = (const int32_t *)(base + offset);
+	offset += pad8(4*nv);
+	block.Nc = (const double *)(base + offset);
+	offset += 8*nv;
+	block.p = (const double *)(base + offset);
+	offset += 8*nv;
+	block.q = (const double *)(base + offset);
+	offset += 8*nv;
+	block.pol_llstat = (const double *)(base + offset);
+	offset += 8*nv;
+	return offset == block.block_bytes;
+}
+
+// Copy site sg of a block into the next site of the batch, keeping only the populations of the column map
+static void add_binary_site(const BinaryBlock &block, size_t sg, const ColumnMap &cm, SiteBatch &batch)
+{
+	const size_t num_pops = batch.num_pops;
+	const size_t tg = batch.num_sites++;
+	const size_t from = sg*cm.input_pops, to = tg*num_pops;
+	batch.scaffold[tg] = block.scaffold;
+	batch.site[tg] = block.site[sg];
+	batch.ref_nuc[tg] = string_view(block.ref_bytes + block.ref_offset[sg], block.ref_offset[sg+1] - block.ref_offset[sg]);
+	if (num_pops < (size_t)cm.input_pops) {
+		for (size_t k = 0; k < num_pops; k++) {
+			size_t ig = from + cm.pop_id[k] - 1;
+			batch.n1[to + k] = block.n1[ig];
+			batch.n2[to + k] = block.n2[ig];
+			batch.cov[to + k] = block.cov[ig];
+			batch.Nc[to + k] = block.Nc[ig];
+			batch.p[to + k] = block.p[ig];
+			batch.q[to + k] = block.q[ig];
+			batch.pol_llstat[to + k] = block.pol_llstat[ig];
+		}
+		return;
+	}
+	memcpy(&batch.n1[to], block.n1 + from, num_pops);
+	memcpy(&batch.n2[to], block.n2 + from, num_pops);
+	memcpy(&batch.cov[to], block.cov + from, 4*num_pops);
+	memcpy(&batch.Nc[to], block.Nc + from, 8*num_pops);
+	memcpy(&batch.p[to], block.p + from, 8*num_pops);
+	memcpy(&batch.q[to], block.q + from, 8*num_pops);
+	memcpy(&batch.pol_llstat[to], block.pol_llstat + from, 8*num_pops);
+}
+
+// Summary of the private alleles of a population for -summary: their number, the sum of their probabilities
+// (the number of private alleles expected), and histograms of focal_frequency in bins of 0.1 from 0 and of
+// log_prob_pa in bins of 1 from 0 down, the last bin also holding everything below
+const int SUMMARY_FREQ_BINS = 10;
+const int SUMMARY_LOG_PROB_BINS = 16;
+struct PopSummary {
+	uint64_t private_alleles;
+	double expected_private_alleles;
+	uint64_t freq_hist[SUMMARY_FREQ_BINS];
+	uint64_t log_prob_hist[SUMMARY_LOG_PROB_BINS];
+};
+
+// Add the private alleles of a batch to the summaries, which are indexed by id_pop
+static void add_to_summary(const vector <PrivateAlleleRecord> &records, vector <PopSummary> &summaries)
+{
+	for (size_t rg = 0; rg < records.size(); rg++) {
+		const PrivateAlleleRecord &pa = records[rg];
+		PopSummary &summary = summaries[pa.id_pop];
+		summary.private_alleles++;
+		summary.expected_private_alleles += pow(10.0, pa.log_prob_pa);
+		double freq_bin = pa.focal_paf*SUMMARY_FREQ_BINS, log_prob_bin = -pa.log_prob_pa;
+		summary.freq_hist[ (freq_bin >= SUMMARY_FREQ_BINS - 1) ? SUMMARY_FREQ_BINS - 1 : (freq_bin > 0.0) ? (int)freq_bin : 0 ]++;
+		summary.log_prob_hist[ (log_prob_bin >= SUMMARY_LOG_PROB_BINS - 1) ? SUMMARY_LOG_PROB_BINS - 1 : (log_prob_bin > 0.0) ? (int)log_prob_bin : 0 ]++;
+	}
+}
+
+// Wall time and counters of one thread.  Each thread fills its own copy without synchronization;
+// the copies are collected in RunStats when the threads finish.
+struct ThreadStats {
+	string name;
+	uint64_t bytes;		// input bytes read
+	uint64_t lines;		// input lines (sites of a binary input) parsed
+	uint64_t sites_skipped;	// lines dropped by the parser: outside -region, or without a possible private allele
+	double read_seconds, parse_seconds, compute_seconds, format_seconds, write_seconds;	// wall time of each stage
+	double cpu_seconds;	// CPU time of the thread
+	uint64_t tasks, tasks_stolen;	// chunks analyzed by a worker, and how many of them it took from the queue of another NUMA node
+	vector <AnalysisCounters> counts;	// for each combination of settings
+	vector < vector <PopSummary> > summaries;	// for each combination of settings, by id_pop (with -summary)
+
+	explicit ThreadStats(const char *t_name = "") : name(t_name), bytes(0), lines(0), sites_skipped(0), read_seconds(0.0), parse_seconds(0.0), compute_seconds(0.0), format_seconds(0.0), write_seconds(0.0), cpu_seconds(0.0), tasks(0), tasks_stolen(0) {}
+};
+
+// Statistics of a whole run, reported by -stats and -stats_json
+struct RunStats {
+	double wall_seconds;	// wall time of the analysis
+	double cpu_seconds;	// CPU time of the process
+	vector <ThreadStats> threads;
+
+	RunStats() : wall_seconds(0.0), cpu_seconds(0.0) {}
+};
+
+// Monotonic wall-clock time in seconds
+static inline double wall_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+// CPU time in seconds of the calling thread (CLOCK_THREAD_CPUTIME_ID) or of the process (CLOCK_PROCESS_CPUTIME_ID)
+static inline double cpu_time(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+// Working storage of the per-site analysis.  Each thread keeps its own copy, reused across sites.
+struct SiteScratch : ComputeScratch {
+	vector <string_view> fields;	// fields of the current line, pointing into the line buffer
+	SiteBatch batch;		// sites parsed but not yet analyzed
+	ThreadStats stats;		// time and counters of the thread
+
+	// Everything a site needs is allocated here, once per thread, and reused for every batch and chunk;
+	// the output records go to the strings of the chunks, which keep their capacity as the chunks are reused
+	explicit SiteScratch(int num_pops)
+	{
+		fields.reserve(3 + 9*(size_t)num_pops);
+		batch.init(num_pops, SITE_BATCH_SIZE);
+		reserve(SITE_BATCH_SIZE);
+	}
+};
+
+// Append an integer to out in the format of %d
+static inline void append_int(string &out, int value)
+{
+	char tmp[16];
+	char *end = to_chars(tmp, tmp + sizeof(tmp), value).ptr;
+	out.append(tmp, end - tmp);
+}
+
+// Append a number to out in the format of %f, i.e. fixed-point with six decimals and the same rounding
+static inline void append_fixed(string &out, double value)
+{
+	char tmp[400];		// enough for any double
+	char *end = to_chars(tmp, tmp + sizeof(tmp), value, chars_format::fixed, 6).ptr;
+	out.append(tmp, end - tmp);
+}
+
+// Append one output record to out
+static void append_record(string &out, string_view scaffold, int site, string_view ref_nuc, int tot_cov, int ne_pops, int num_alleles, string_view private_allele, int id_pop, double focal_paf, double total_paf, double log_prob_pa, double maf_total)
+{
+	out.append(scaffold);
+	out.push_back('\t');
+	append_int(out, site);
+	out.push_back('\t');
+	out.append(ref_nuc);
+	out.push_back('\t');
+	append_int(out, tot_cov);
+	out.push_back('\t');
+	append_int(out, ne_pops);
+	out.push_back('\t');
+	append_int(out, num_alleles);
+	out.push_back('\t');
+	out.append(private_allele);
+	out.push_back('\t');
+	append_int(out, id_pop);
+	out.push_back('\t');
+	append_fixed(out, focal_paf);
+	out.push_back('\t');
+	append_fixed(out, total_paf);
+	out.push_back('\t');
+	append_fixed(out, log_prob_pa);
+	out.push_back('\t');
+	append_fixed(out, maf_total);
+	out.push_back('\n');
+}
+
+// Output stage: collects the records in a large buffer and writes them to the stream in big blocks
+class OutputWriter {
+public:
+	explicit OutputWriter(FILE *t_stream, uint64_t t_bytes_written = 0, size_t t_block_bytes = (size_t)8 << 20) : stream(t_stream), block_bytes(t_block_bytes), bytes_written(t_bytes_written), failed(false)
+	{
+		buffer.reserve(block_bytes);
+	}
+
+	void write(string_view data)
+	{
+		if (buffer.size() + data.size() > block_bytes) {
+			flush();
+		}
+		if (data.size() >= block_bytes) {
+			write_block(data);
+		} else {
+			buffer.append(data);
+		}
+	}
+
+	// Write out the buffered records; returns false if any write has failed
+	bool flush()
+	{
+		if ( !buffer.empty() ) {
+			write_block(buffer);
+			buffer.clear();
+		}
+		return !failed;
+	}
+
+	// Write out the buffered records and commit them to the file; returns false if any write has failed
+	bool sync()
+	{
+		if ( !flush() || fflush(stream) != 0 ) {
+			failed = true;
+		} else {
+			fsync( fileno(stream) );	// may fail for pipes and terminals, which is harmless
+		}
+		return !failed;
+	}
+
+	uint64_t size() const { return bytes_written + buffer.size(); }	// bytes of output so far, the buffer included
+
+private:
+	void write_block(string_view data)
+	{
+		if ( fwrite(data.data(), 1, data.size(), stream) != data.size() ) {
+			failed = true;
+		}
+		bytes_written += data.size();
+	}
+
+	FILE *stream;
+	size_t block_bytes;	// size of the blocks written to the stream
+	string buffer;
+	uint64_t bytes_written;	// bytes passed to the stream, counting from the start of the file
+	bool failed;
+};
+
+// Parse one line of the input into the next site of the batch.  Returns false when the site is skipped.
+// A site dropped by config.reject_sites never reaches compute_batch, so when counts is given the parser
+// adds it to the counters of each combination of the sweep itself, as compute_batch would have; a site
+// dropped at the lowest min_Nc of the sweep has no private allele at a higher one either.
+static bool parse_site(string_view line, const FPAConfig &config, vector <string_view> &fields, SiteBatch &batch, const FPASweep *sweep = NULL, vector <AnalysisCounters> *counts = NULL)
+{
+	const int num_pops = config.num_pops;
+	int site;
+	if (config.use_region) {	// Skip sites outside the region before splitting the whole line
+		split_fields(line, fields, 2);
+		site = parse_int(fields[1]);
+		if ( fields[0] != config.region_scaffold || site < config.region_start || site > config.region_end ) {
+			return false;
+		}
+	}
+	const ColumnMap &cm = config.columns;
+	split_fields(line, fields, cm.num_fields);	// the columns after the last used one are not split
+	size_t sg = batch.num_sites;
+	size_t row = sg*num_pops;
+
+	// First the alleles and Nc only.  A site where fewer than two populations pass min_Nc, or where all
+	// of them have the same major allele and no minor allele, has no private allele: with config.reject_sites
+	// it is dropped here, before the rest of its fields are converted.
+	int num_qualified = 0, num_with_data = 0;
+	int last_qualified = 0;		// index of the last population passing min_Nc
+	unsigned int allele_mask = 0;
+	bool has_minor = false;
+	for (int k = 0; k < num_pops; k++) {
+		// Only the fields of the column map are read; the others are never converted
+		const string_view *pop_fields = &fields[3 + cm.pop_width*(cm.pop_id[k] - 1)];
+		size_t ig = row + k;
+		unsigned char n1 = allele_code(pop_fields[cm.offset[COL_N1]]);
+		unsigned char n2 = allele_code(pop_fields[cm.offset[COL_N2]]);
+		double Nc = 0.0;
+		if (n1 != ALLELE_NA) {
+			Nc = parse_double(pop_fields[cm.offset[COL_NC]]);
+			num_with_data++;
+			if (Nc >= config.min_Nc) {
+				num_qualified++;
+				last_qualified = k;
+				allele_mask |= 1u << n1;
+				has_minor = has_minor || (n2 != ALLELE_NA && n2 != n1);
+			}
+		}
+		batch.n1[ig] = n1;
+		batch.n2[ig] = n2;
+		batch.Nc[ig] = Nc;
+	}
+	if ( config.reject_sites && ( num_qualified < 2 || (!has_minor && (allele_mask & (allele_mask - 1)) == 0) ) ) {
+		if (counts != NULL) {
+			// With one population passing min_Nc, its minor allele is a new allele when it passes the polymorphism test
+			double pol_llstat = 0.0;
+			if (num_qualified == 1 && has_minor) {
+				pol_llstat = parse_double(fields[3 + cm.pop_width*(cm.pop_id[last_qualified] - 1) + cm.offset[COL_POL_LLSTAT]]);
+			}
+			for (size_t cg = 0; cg < sweep->combos.size(); cg++) {
+				const FPAConfig &combo = sweep->combos[cg];
+				int ne_pops = num_qualified;
+				if (combo.min_Nc != config.min_Nc) {
+					ne_pops = 0;
+					for (int k = 0; k < num_pops; k++) {
+						ne_pops += (batch.n1[row + k] != ALLELE_NA && batch.Nc[row + k] >= combo.min_Nc);
+					}
+				}
+				AnalysisCounters &c = (*counts)[cg];
+				c.sites_analyzed += (ne_pops >= 2);
+				c.pops_below_min_Nc += num_with_data - ne_pops;
+				c.alleles_by_pol_test += (ne_pops == 1 && has_minor && pol_llstat > combo.cv);
+			}
+		}
+		return false;
+	}
+
+	batch.num_sites++;
+	batch.scaffold[sg] = fields[0];
+	batch.site[sg] = parse_int(fields[1]);
+	batch.ref_nuc[sg] = fields[2];
+	for (int k = 0; k < num_pops; k++) {
+		const string_view *pop_fields = &fields[3 + cm.pop_width*(cm.pop_id[k] - 1)];
+		size_t ig = row + k;
+		double p = 0.0, q = 0.0, pol_llstat = 0.0;
+		if (batch.n1[ig] != ALLELE_NA && batch.Nc[ig] >= config.min_Nc) {
+			p = parse_double(pop_fields[cm.offset[COL_P]]);
+			if (batch.n2[ig] != ALLELE_NA) {
+				q = parse_double(pop_fields[cm.offset[COL_Q]]);
+				pol_llstat = parse_double(pop_fields[cm.offset[COL_POL_LLSTAT]]);
+			}
+		}
+		batch.cov[ig] = parse_int(pop_fields[cm.offset[COL_COV]]);
+		batch.p[ig] = p;
+		batch.q[ig] = q;
+		batch.pol_llstat[ig] = pol_llstat;
+	}
+	return true;
+}
+
+// Append the output records of the private alleles of a batch to out
+static void format_records(const SiteBatch &batch, const vector <PrivateAlleleRecord> &records, string &out)
+{
+	for (size_t rg = 0; rg < records.size(); rg++) {
+		const PrivateAlleleRecord &pa = records[rg];
+		append_record(out, batch.scaffold[pa.site_index], batch.site[pa.site_index], batch.ref_nuc[pa.site_index], pa.tot_cov, pa.ne_pops, pa.num_alleles, string_view(&allele_chars[pa.allele], 1), pa.id_pop, pa.focal_paf, pa.total_paf, pa.log_prob_pa, pa.maf_total);
+	}
+}
+
+// Analyze the sites of a batch for every combination of settings and empty the batch
+static void analyze_batch_sweep(const FPASweep &sweep, SiteScratch &sc, vector <string> &outs)
+{
+	ThreadStats &stats = sc.stats;
+	stats.counts.resize( sweep.combos.size() );
+	for (size_t cg = 0; cg < sweep.combos.size(); cg++) {
+		double start = wall_time();
+		compute_batch(sc.batch, sweep.combos[cg], sc, stats.counts[cg]);
+		if (sweep.summarize) {
+			stats.summaries.resize( sweep.combos.size() );
+			stats.summaries[cg].resize(sweep.parse.columns.input_pops + 1);
+			add_to_summary(sc.records, stats.summaries[cg]);
+		}
+		double computed = wall_time();
+		format_records(sc.batch, sc.records, outs[cg]);
+		stats.compute_seconds += computed - start;
+		stats.format_seconds += wall_time() - computed;
+	}
+	sc.batch.num_sites = 0;
+}
+
+// Analyze every line of a chunk
+static void analyze_chunk(string_view chunk, const FPASweep &sweep, SiteScratch &sc, vector <string> &outs)
+{
+	const FPAConfig &config = sweep.parse;
+	sc.stats.counts.resize( sweep.combos.size() );
+	double start_time = wall_time(), analysis_seconds = sc.stats.compute_seconds + sc.stats.format_seconds;
+	size_t pos = 0;
+	while (pos < chunk.size()) {
+		const char *start = chunk.data() + pos;
+		const char *nl = (const char *)memchr(start, '\n', chunk.size() - pos);
+		size_t len = (nl != NULL) ? (size_t)(nl - start) : chunk.size() - pos;
+		if ( !parse_site(string_view(start, len), config, sc.fields, sc.batch, &sweep, &sc.stats.counts) ) {
+			sc.stats.sites_skipped++;
+		}
+		sc.stats.lines++;
+		if ( sc.batch.full() ) {
+			analyze_batch_sweep(sweep, sc, outs);
+		}
+		pos = pos + len + 1;
+	}
+	if (sc.batch.num_sites > 0) {	// the batch points into the chunk, so it is finished with the chunk
+		analyze_batch_sweep(sweep, sc, outs);
+	}
+	// Parsing takes the time of the chunk not spent in the analysis of its batches
+	analysis_seconds = sc.stats.compute_seconds + sc.stats.format_seconds - analysis_seconds;
+	sc.stats.parse_seconds += wall_time() - start_time - analysis_seconds;
+}
+
+// Analyze every site of a chunk of whole blocks of a binary columnar file
+static void analyze_binary_chunk(string_view chunk, const FPASweep &sweep, SiteScratch &sc, vector <string> &outs)
+{
+	const FPAConfig &config = sweep.parse;
+	double start_time = wall_time(), analysis_seconds = sc.stats.compute_seconds + sc.stats.format_seconds;
+	BinaryBlock block;
+	while ( !chunk.empty() && decode_binary_block(chunk, config.columns.input_pops, block) ) {
+		bool in_region = !config.use_region || ( block.scaffold == config.region_scaffold && block.last_site >= config.region_start && block.first_site <= config.region_end );
+		for (size_t sg = 0; in_region && sg < block.num_sites; sg++) {
+			if ( config.use_region && (block.site[sg] < config.region_start || block.site[sg] > config.region_end) ) {
+				continue;
+			}
+			add_binary_site(block, sg, config.columns, sc.batch);
+			sc.stats.lines++;
+			if ( sc.batch.full() ) {
+				analyze_batch_sweep(sweep, sc, outs);
+			}
+		}
+		chunk.remove_prefix(block.block_bytes);
+	}
+	if (sc.batch.num_sites > 0) {
+		analyze_batch_sweep(sweep, sc, outs);
+	}
+	analysis_seconds = sc.stats.compute_seconds + sc.stats.format_seconds - analysis_seconds;
+	sc.stats.parse_seconds += wall_time() - start_time - analysis_seconds;
+}
+
+// Convert the rest of a text input to the binary columnar format
+static bool convert_input(InputReader &inputFile, string_view header, const FPAConfig &config, const char *file_name)
+{
+	FILE *binstream = fopen(file_name, "wb");
+	if (binstream == NULL) {
+		fprintf(stderr, "Cannot open %s for writing.\n", file_name);
+		return false;
+	}
+	string out;
+	out.append(BINARY_MAGIC, 8);
+	uint32_t num_pops = config.num_pops, header_len = (uint32_t)header.size();
+	out.append((const char *)&num_pops, 4);
+	out.append((const char *)&header_len, 4);
+	write_padded(out, header.data(), header.size());
+
+	FPAConfig all_values = config;	// convert every value an analysis could use, whatever its min_Nc
+	all_values.min_Nc = -HUGE_VAL;
+	all_values.reject_sites = false;
+	all_values.use_region = false;
+	SiteBatch batch;
+	batch.init(config.num_pops, BINARY_BLOCK_SIZE);
+	vector <string_view> fields;
+	string_view chunk;
+	string storage;
+	bool ok = true;
+	while ( ok && inputFile.next_chunk((size_t)4 << 20, chunk, storage) ) {
+		size_t pos = 0;
+		while (pos < chunk.size()) {
+			const char *start = chunk.data() + pos;
+			const char *nl = (const char *)memchr(start, '\n', chunk.size() - pos);
+			size_t len = (nl != NULL) ? (size_t)(nl - start) : chunk.size() - pos;
+			parse_site(string_view(start, len), all_values, fields, batch);
+			pos = pos + len + 1;
+			// A block holds one scaffold: write out the sites before a new scaffold
+			size_t last = batch.num_sites - 1;
+			if ( last > 0 && batch.scaffold[last] != batch.scaffold[0] ) {
+				write_binary_block(out, batch, 0, last);
+				batch.copy_site(last, 0);
+				batch.num_sites = 1;
+			} else if ( batch.full() ) {
+				write_binary_block(out, batch, 0, batch.num_sites);
+				batch.num_sites = 0;
+			}
+		}
+		if (batch.num_sites > 0) {	// the batch points into the chunk
+			write_binary_block(out, batch, 0, batch.num_sites);
+			batch.num_sites = 0;
+		}
+		ok = ( fwrite(out.data(), 1, out.size(), binstream) == out.size() );
+		out.clear();
+	}
+	if ( fclose(binstream) != 0 || !ok ) {
+		fprintf(stderr, "Error writing to %s.\n", file_name);
+		return false;
+	}
+	return true;
+}
+
+// A chunk of whole input lines and the output produced from it
+struct Chunk {
+	string_view data;	// lines of the chunk
+	string storage;		// copy of the lines when the input is streamed
+	vector <string> out;	// output records of the chunk, for each combination of settings
+	uint64_t lines;		// number of lines (sites of a binary input) in the chunk
+	uint64_t end_offset;	// offset of the input at the end of the chunk
+	size_t node;		// NUMA node of the buffers of the chunk (0 without -numa)
+	uint64_t seq;		// sequence number of the task in the input, the order of the output
+};
+
+// Progress of a run, updated by the writer once per chunk and read by the progress monitor
+struct Progress {
+	atomic <uint64_t> bytes;	// input bytes written out
+	atomic <uint64_t> sites;	// sites written out
+	mutex scaffold_mtx;
+	string scaffold;		// scaffold of the last site written out
+
+	Progress() : bytes(0), sites(0) {}
+};
+
+// Scaffold and position of the last site of a chunk
+static string_view last_site(string_view data, bool binary, int &site)
+{
+	if (binary) {	// walk the block headers to the last block
+		size_t pos = 0;
+		uint64_t block_bytes;
+		while (true) {
+			memcpy(&block_bytes, data.data() + pos, 8);
+			if (pos + block_bytes >= data.size()) {
+				break;
+			}
+			pos = pos + block_bytes;
+		}
+		uint32_t scaffold_len;
+		int32_t block_last_site;
+		memcpy(&scaffold_len, data.data() + pos + 12, 4);
+		memcpy(&block_last_site, data.data() + pos + 20, 4);
+		site = block_last_site;
+		return data.substr(pos + 24, scaffold_len);
+	}
+	size_t end = data.size();
+	if (end > 0 && data[end-1] == '\n') {
+		end--;
+	}
+	size_t begin = data.rfind('\n', (end > 0) ? end - 1 : 0);
+	begin = (begin == string_view::npos || begin >= end) ? 0 : begin + 1;
+	string_view last = data.substr(begin, end - begin);
+	vector <string_view> fields;
+	split_fields(last, fields, 2);
+	site = parse_int(fields[1]);
+	return fields[0];
+}
+
+// Record a chunk written out
+static void update_progress(Progress *progress, const Chunk &chunk, bool binary)
+{
+	if (progress == NULL || chunk.data.empty()) {
+		return;
+	}
+	int site;
+	string_view scaffold = last_site(chunk.data, binary, site);
+	{
+		lock_guard <mutex> guard(progress->scaffold_mtx);
+		progress->scaffold.assign(scaffold.data(), scaffold.size());
+	}
+	progress->bytes += chunk.data.size();
+	progress->sites += chunk.lines;
+}
+
+// Thread printing the progress of the run at a fixed interval to stderr, or writing it to a status file
+// that is replaced atomically, so that another process never reads a partial status
+class ProgressMonitor {
+public:
+	ProgressMonitor(Progress &t_progress, double t_interval, const char *t_file_name, uint64_t t_total_bytes) : progress(t_progress), interval(t_interval), file_name(t_file_name), total_bytes(t_total_bytes), stopping(false)
+	{
+		start_time = wall_time();
+		monitor = thread([this]() { run(); });
+	}
+
+	~ProgressMonitor() { stop(); }
+
+	// Stop the monitor after a last report
+	void stop()
+	{
+		if ( !monitor.joinable() ) {
+			return;
+		}
+		{
+			lock_guard <mutex> guard(mtx);
+			stopping = true;
+		}
+		cv_stop.notify_one();
+		monitor.join();
+	}
+
+private:
+	void run()
+	{
+		unique_lock <mutex> lock(mtx);
+		while (!stopping) {
+			cv_stop.wait_for(lock, chrono::duration <double> (interval));
+			report(stopping);
+		}
+	}
+
+	void report(bool finished)
+	{
+		double elapsed = wall_time() - start_time;
+		uint64_t bytes = progress.bytes, sites = progress.sites;
+		string scaffold;
+		{
+			lock_guard <mutex> guard(progress.scaffold_mtx);
+			scaffold = progress.scaffold;
+		}
+		double rate = (elapsed > 0.0) ? sites/elapsed : 0.0;
+		char text[512], eta[64];
+		if (finished) {
+			snprintf(eta, sizeof(eta), "done in %.1f s", elapsed);
+		} else if (total_bytes > 0 && bytes > 0) {
+			long remaining = (long)( elapsed*(total_bytes - min(bytes, total_bytes))/bytes + 0.5 );
+			snprintf(eta, sizeof(eta), "ETA %ld:%02ld:%02ld", remaining/3600, remaining/60%60, remaining%60);
+		} else {
+			snprintf(eta, sizeof(eta), "ETA unknown");
+		}
+		if (total_bytes > 0) {
+			snprintf(text, sizeof(text), "progress: scaffold %s, %llu sites, %.1f of %.1f MB (%.1f%%), %.0f sites/s, %s\n", scaffold.c_str(), (unsigned long long)sites, bytes/1e6, total_bytes/1e6, 100.0*bytes/total_bytes, rate, eta);
+		} else {
+			snprintf(text, sizeof(text), "progress: scaffold %s, %llu sites, %.1f MB, %.0f sites/s, %s\n", scaffold.c_str(), (unsigned long long)sites, bytes/1e6, rate, eta);
+		}
+		if (file_name == NULL) {
+			fputs(text, stderr);
+			return;
+		}
+		string tmp_name = string(file_name) + ".tmp";
+		FILE *statusstream = fopen(tmp_name.c_str(), "w");
+		if (statusstream != NULL) {
+			fputs(text, statusstream);
+			if ( fclose(statusstream) == 0 ) {
+				rename(tmp_name.c_str(), file_name);
+			}
+		}
+	}
+
+	Progress &progress;
+	double interval;	// seconds between reports
+	const char *file_name;	// status file, or NULL for stderr
+	uint64_t total_bytes;	// bytes to be read, or 0 when unknown
+	double start_time;
+	mutex mtx;
+	condition_variable cv_stop;
+	bool stopping;
+	thread monitor;
+};
+
+// Clear the outputs of a chunk, one for each combination of settings
+static void clear_outputs(Chunk &chunk, size_t num_combos)
+{
+	chunk.out.resize(num_combos);
+	for (size_t cg = 0; cg < num_combos; cg++) {
+		chunk.out[cg].clear();
+	}
+}
+
+// Write the outputs of a chunk, one writer for each combination of settings
+static void write_outputs(const Chunk &chunk, vector <OutputWriter *> &writers)
+{
+	for (size_t cg = 0; cg < writers.size(); cg++) {
+		writers[cg]->write(chunk.out[cg]);
+	}
+}
+
+// State of a run saved in a checkpoint file: the input offset up to which all output is written, the last
+// site analyzed and the size of each output file at that point.  The first line identifies the input file
+// and the second the settings, so that a run is only resumed from its own checkpoint.
+struct CheckpointState {
+	uint64_t input_offset;
+	string scaffold;	// last site analyzed
+	int site;
+	vector <uint64_t> out_offsets;	// size of each output file, in the order of the combinations
+};
+
+// Write the checkpoint file; it is replaced atomically with a rename, so it is never left half-written
+static bool write_checkpoint(const string &file_name, uint64_t in_size, int64_t in_mtime, const string &settings, const vector <string> &out_names, const CheckpointState &state)
+{
+	string tmp_name = file_name + ".tmp";
+	FILE *ckptstream = fopen(tmp_name.c_str(), "w");
+	if (ckptstream == NULL) {
+		return false;
+	}
+	fprintf(ckptstream, "#FPA_checkpoint\t%llu\t%lld\n", (unsigned long long)in_size, (long long)in_mtime);
+	fprintf(ckptstream, "settings\t%s\n", settings.c_str());
+	fprintf(ckptstream, "input\t%llu\n", (unsigned long long)state.input_offset);
+	fprintf(ckptstream, "last_site\t%s\t%d\n", state.scaffold.c_str(), state.site);
+	for (size_t cg = 0; cg < out_names.size(); cg++) {
+		fprintf(ckptstream, "output\t%llu\t%s\n", (unsigned long long)state.out_offsets[cg], out_names[cg].c_str());
+	}
+	bool ok = ( fflush(ckptstream) == 0 && fsync(fileno(ckptstream)) == 0 );
+	ok = ( fclose(ckptstream) == 0 ) && ok;
+	return ok && rename(tmp_name.c_str(), file_name.c_str()) == 0;
+}
+
+// Read a checkpoint file; returns false when it is missing, malformed or made for another input, other
+// settings or other output files
+static bool read_checkpoint(const string &file_name, uint64_t in_size, int64_t in_mtime, const string &settings, const vector <string> &out_names, CheckpointState &state)
+{
+	ifstream ckptfile(file_name.c_str());
+	string line;
+	char expected[64];
+	snprintf(expected, sizeof(expected), "#FPA_checkpoint\t%llu\t%lld", (unsigned long long)in_size, (long long)in_mtime);
+	if ( !getline(ckptfile, line) || line != expected ) {
+		return false;
+	}
+	if ( !getline(ckptfile, line) || line != "settings\t" + settings ) {
+		return false;
+	}
+	vector <string_view> fields;
+	state.out_offsets.clear();
+	bool have_input = false;
+	while ( getline(ckptfile, line) ) {
+		split_fields(line, fields, 3);
+		if (fields[0] == "input") {
+			state.input_offset = strtoull(string(fields[1]).c_str(), NULL, 10);
+			have_input = true;
+		} else if (fields[0] == "last_site") {
+			state.scaffold = string(fields[1]);
+			state.site = parse_int(fields[2]);
+		} else if (fields[0] == "output") {
+			size_t cg = state.out_offsets.size();
+			if (cg >= out_names.size() || fields[2] != out_names[cg]) {
+				return false;
+			}
+			state.out_offsets.push_back( strtoull(string(fields[1]).c_str(), NULL, 10) );
+		}
+	}
+	return have_input && state.out_offsets.size() == out_names.size();
+}
+
+// Writes a checkpoint after a chunk is written out, at most once per interval
+class Checkpointer {
+public:
+	Checkpointer(const string &t_file_name, double t_interval, uint64_t t_in_size, int64_t t_in_mtime, const string &t_settings, const vector <string> &t_out_names) : file_name(t_file_name), interval(t_interval), in_size(t_in_size), in_mtime(t_in_mtime), settings(t_settings), out_names(t_out_names), last_time(wall_time()), failed(false) {}
+
+	void chunk_written(const Chunk &chunk, bool binary, vector <OutputWriter *> &writers)
+	{
+		if (chunk.data.empty() || wall_time() - last_time < interval) {
+			return;
+		}
+		CheckpointState state;
+		state.input_offset = chunk.end_offset;
+		state.scaffold = string( last_site(chunk.data, binary, state.site) );
+		bool ok = true;
+		for (size_t cg = 0; cg < writers.size(); cg++) {
+			ok = writers[cg]->sync() && ok;
+			state.out_offsets.push_back( writers[cg]->size() );
+		}
+		if ( !ok || !write_checkpoint(file_name, in_size, in_mtime, settings, out_names, state) ) {
+			if (!failed) {
+				fprintf(stderr, "Cannot write the checkpoint %s; continuing without it.\n", file_name.c_str());
+			}
+			failed = true;
+		}
+		last_time = wall_time();
+	}
+
+private:
+	string file_name;
+	double interval;	// minimum number of seconds between checkpoints
+	uint64_t in_size;
+	int64_t in_mtime;
+	string settings;
+	vector <string> out_names;
+	double last_time;	// time of the last checkpoint
+	bool failed;
+};
+
+// CPUs of each NUMA node, read from /sys/devices/system/node; empty when the information is not available
+static vector < vector <int> > numa_node_cpus()
+{
+	vector < vector <int> > nodes;
+	DIR *dir = opendir("/sys/devices/system/node");
+	if (dir == NULL) {
+		return nodes;
+	}
+	vector <int> node_ids;
+	struct dirent *entry;
+	while ( (entry = readdir(dir)) != NULL ) {
+		int id;
+		char tail;
+		if ( sscanf(entry->d_name, "node%d%c", &id, &tail) == 1 ) {
+			node_ids.push_back(id);
+		}
+	}
+	closedir(dir);
+	sort(node_ids.begin(), node_ids.end());
+	for (size_t ng = 0; ng < node_ids.size(); ng++) {
+		char file_name[64];
+		snprintf(file_name, sizeof(file_name), "/sys/devices/system/node/node%d/cpulist", node_ids[ng]);
+		ifstream cpulist(file_name);
+		string list;
+		vector <int> cpus;
+		getline(cpulist, list);
+		for (size_t begin = 0, end; begin < list.size(); begin = end + 1) {	// e.g. 0-15,32-47
+			end = min(list.find(',', begin), list.size());
+			int first, last;
+			int num_read = sscanf(list.c_str() + begin, "%d-%d", &first, &last);
+			if (num_read == 1) {
+				last = first;
+			}
+			for (int cg = first; num_read >= 1 && cg <= last; cg++) {
+				cpus.push_back(cg);
+			}
+		}
+		if ( !cpus.empty() ) {	// nodes with memory only have no CPUs
+			nodes.push_back(cpus);
+		}
+	}
+	return nodes;
+}
+
+// Restrict the calling thread to the given CPUs; memory it touches first is then allocated on their node
+static bool pin_thread(const vector <int> &cpus)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t cg = 0; cg < cpus.size(); cg++) {
+		if (cpus[cg] < CPU_SETSIZE) {
+			CPU_SET(cpus[cg], &set);
+		}
+	}
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// Analyze the rest of the input and write the results.  With more than one thread, a reader thread
+// queues chunks for a pool of workers, and the writer writes them back in input
+// order, so the output is identical to that of the serial run.  The time and counters of
+// each thread are collected in stats, and the chunks written out are recorded in progress and checkpointer
+// unless they are NULL.
+// With the CPUs of two or more NUMA nodes in numa_nodes, the workers are spread over the nodes and pinned
+// to them, as are the reader and the writer to the first node.  Each worker allocates and first touches
+// the buffers of its share of the chunks, so that they are on its node; the reader queues each chunk for the
+// workers of its node, and a worker takes the tasks of another node only when its own node has none.
+static void process_input(InputReader &inputFile, const FPASweep &sweep, vector <OutputWriter *> &writers, int num_threads, RunStats &stats, Progress *progress = NULL, Checkpointer *checkpointer = NULL, const vector < vector <int> > *numa_nodes = NULL)
+{
+	const bool binary = inputFile.is_binary();
+	const size_t chunk_bytes = (size_t)4 << 20;	// target size of a chunk
+	const size_t num_combos = sweep.combos.size();
+	void (*analyze)(string_view, const FPASweep &, SiteScratch &, vector <string> &) = inputFile.is_binary() ? analyze_binary_chunk : analyze_chunk;
+
+	double start_time = wall_time(), start_cpu = cpu_time(CLOCK_PROCESS_CPUTIME_ID);
+	if (num_threads <= 1) {
+		Chunk chunk;
+		SiteScratch scratch(sweep.parse.num_pops);
+		ThreadStats &ts = scratch.stats;
+		ts.name = "main";
+		double start_thread_cpu = cpu_time(CLOCK_THREAD_CPUTIME_ID);
+		while (true) {
+			double t0 = wall_time();
+			bool got_chunk = inputFile.next_chunk(chunk_bytes, chunk.data, chunk.storage);
+			ts.read_seconds += wall_time() - t0;
+			if (!got_chunk) {
+				break;
+			}
+			chunk.end_offset = inputFile.offset();
+			ts.bytes += chunk.data.size();
+			clear_outputs(chunk, num_combos);
+			uint64_t lines = ts.lines;
+			analyze(chunk.data, sweep, scratch, chunk.out);
+			chunk.lines = ts.lines - lines;
+			t0 = wall_time();
+			write_outputs(chunk, writers);
+			ts.write_seconds += wall_time() - t0;
+			update_progress(progress, chunk, binary);
+			if (checkpointer != NULL) {
+				checkpointer->chunk_written(chunk, binary, writers);
+			}
+		}
+		ts.cpu_seconds = cpu_time(CLOCK_THREAD_CPUTIME_ID) - start_thread_cpu;
+		stats.threads.push_back(ts);
+		stats.wall_seconds = wall_time() - start_time;
+		stats.cpu_seconds = cpu_time(CLOCK_PROCESS_CPUTIME_ID) - start_cpu;
+		return;
+	}
+
+	// The input is cut into tasks of task_bytes whole lines (whole blocks of a binary input), regardless of
+	// the scaffolds, and queued in input order: one FIFO without NUMA placement, else one per node, dealt to
+	// the nodes in turn.  A worker takes the oldest task of its node and, when that queue is empty, the
+	// oldest task of any node.  The writer waits for the lowest sequence number outstanding and only
+	// max_in_flight chunks exist, so taking the oldest task first frees the chunks behind a slow task
+	// soonest.  Tasks are small enough that each thread gets a few dozens of a regular file, so the load
+	// balances over a dense or long scaffold.  The queues share the pipeline mutex, which is taken a few
+	// times per task of many sites.
+	size_t task_bytes = chunk_bytes;
+	if ( inputFile.is_regular() ) {
+		uint64_t per_task = (inputFile.end_offset() - inputFile.offset())/(32*(uint64_t)num_threads);
+		task_bytes = (size_t)max( (uint64_t)256 << 10, min( (uint64_t)chunk_bytes, per_task ) );
+	}
+	mutex mtx;
+	condition_variable cv_work;	// signals tasks waiting in queues
+	condition_variable cv_done;	// signals finished tasks
+	condition_variable cv_free;	// signals chunks returned by the writer
+	const size_t num_nodes = (numa_nodes != NULL && numa_nodes->size() > 1) ? numa_nodes->size() : 1;
+	vector < deque <Chunk *> > queues(num_nodes);	// tasks waiting, by node, oldest first
+	size_t num_queued = 0;		// tasks in queues
+	vector < vector <Chunk *> > free_chunks(num_nodes);	// chunks available to the reader, by node
+	vector < unique_ptr<Chunk> > all_chunks;
+	bool end_of_input = false;
+	const size_t max_in_flight = 4*(size_t)num_threads;
+	vector <Chunk *> finished(max_in_flight, NULL);	// finished tasks, at their sequence number modulo max_in_flight
+	uint64_t num_read = 0;		// tasks read, i.e. the sequence number of the next one
+	const bool place_chunks = (num_nodes > 1);	// the workers allocate the chunks on their nodes
+	const bool touch_storage = place_chunks && !inputFile.is_mapped();	// chunks are copied into storage
+
+	vector <thread> workers;
+	for (int tg = 0; tg < num_threads; tg++) {
+		workers.push_back( thread([&, tg]() {
+			const size_t node = tg % num_nodes;
+			if (place_chunks) {
+				pin_thread( (*numa_nodes)[node] );
+				vector < unique_ptr<Chunk> > own_chunks;
+				for (size_t cg = 0; cg < max_in_flight/num_threads; cg++) {
+					own_chunks.push_back( unique_ptr<Chunk>(new Chunk) );
+					own_chunks.back()->node = node;
+					if (touch_storage) {	// resize writes the pages, so they are placed on this node
+						own_chunks.back()->storage.resize(task_bytes + ((size_t)64 << 10));
+						own_chunks.back()->storage.clear();
+					}
+				}
+				lock_guard <mutex> guard(mtx);
+				for (size_t cg = 0; cg < own_chunks.size(); cg++) {
+					free_chunks[node].push_back( own_chunks[cg].get() );
+					all_chunks.push_back( move(own_chunks[cg]) );
+				}
+				cv_free.notify_one();
+			}
+			SiteScratch scratch(sweep.parse.num_pops);
+			scratch.stats.name = "worker " + to_string(tg + 1);
+			unique_lock <mutex> lock(mtx);
+			while (true) {
+				while ( num_queued == 0 && !end_of_input ) {
+					cv_work.wait(lock);
+				}
+				if (num_queued == 0) {
+					scratch.stats.cpu_seconds = cpu_time(CLOCK_THREAD_CPUTIME_ID);	// the thread started with the call
+					stats.threads.push_back(scratch.stats);
+					return;
+				}
+				size_t from = node;	// queue of the node, else the one with the oldest task
+				for (size_t ng = 0; ng < num_nodes && queues[node].empty(); ng++) {
+					if ( !queues[ng].empty() && (queues[from].empty() || queues[ng].front()->seq < queues[from].front()->seq) ) {
+						from = ng;
+					}
+				}
+				Chunk *chunk = queues[from].front();
+				queues[from].pop_front();
+				scratch.stats.tasks_stolen += (from != node);
+				num_queued--;
+				scratch.stats.tasks++;
+				lock.unlock();
+				clear_outputs(*chunk, num_combos);
+				uint64_t lines = scratch.stats.lines;
+				analyze(chunk->data, sweep, scratch, chunk->out);
+				chunk->lines = scratch.stats.lines - lines;
+				lock.lock();
+				finished[chunk->seq % max_in_flight] = chunk;
+				cv_done.notify_one();
+			}
+		}) );
+	}
+
+	// Reader: fills free chunks from the input and queues them for the workers.  At most max_in_flight
+	// chunks exist, so when the output is consumed slowly the reader stops, and the input pipe fills up
+	// in turn.
+	ThreadStats reader_stats("reader"), writer_stats("writer");
+	thread reader([&]() {
+		ThreadStats &ts = reader_stats;
+		if (place_chunks) {
+			pin_thread( (*numa_nodes)[0] );
+		}
+		size_t next_node = 0;	// tasks are dealt to the nodes in turn
+		unique_lock <mutex> lock(mtx);
+		while (true) {
+			// A free chunk of the next node, else a new one, else a free chunk of any node
+			const size_t target = next_node;
+			Chunk *chunk = NULL;
+			while (chunk == NULL) {
+				size_t node = target;
+				if ( free_chunks[node].empty() && !place_chunks && all_chunks.size() < max_in_flight ) {
+					all_chunks.push_back( unique_ptr<Chunk>(new Chunk) );
+					all_chunks.back()->node = node;
+					free_chunks[node].push_back( all_chunks.back().get() );
+				}
+				for (size_t ng = 0; ng < num_nodes && free_chunks[node].empty(); ng++) {
+					node = (target + ng) % num_nodes;
+				}
+				if ( free_chunks[node].empty() ) {
+					cv_free.wait(lock);
+					continue;
+				}
+				chunk = free_chunks[node].back();
+				free_chunks[node].pop_back();
+			}
+			lock.unlock();
+			double t0 = wall_time();
+			bool got_chunk = inputFile.next_chunk(task_bytes, chunk->data, chunk->storage);
+			ts.read_seconds += wall_time() - t0;
+			ts.bytes += got_chunk ? chunk->data.size() : 0;
+			lock.lock();
+			if (!got_chunk) {
+				ts.cpu_seconds = cpu_time(CLOCK_THREAD_CPUTIME_ID);
+				free_chunks[chunk->node].push_back(chunk);
+				end_of_input = true;
+				cv_work.notify_all();
+				cv_done.notify_all();
+				return;
+			}
+			chunk->end_offset = inputFile.offset();
+			chunk->seq = num_read++;
+			queues[chunk->node].push_back(chunk);
+			next_node = (next_node + 1) % num_nodes;
+			num_queued++;
+			cv_work.notify_all();	// a worker of the node, or any idle worker
+		}
+	});
+
+	// Writer (this thread): writes the finished tasks in order and hands their chunks back to the reader
+	if (place_chunks) {
+		pin_thread( (*numa_nodes)[0] );
+	}
+	double start_thread_cpu = cpu_time(CLOCK_THREAD_CPUTIME_ID);
+	uint64_t next_write = 0;	// sequence number of the next task to write
+	unique_lock <mutex> lock(mtx);
+	while (true) {
+		while ( finished[next_write % max_in_flight] == NULL && !( end_of_input && next_write == num_read ) ) {
+			cv_done.wait(lock);
+		}
+		if ( finished[next_write % max_in_flight] == NULL ) {	// all tasks written
+			break;
+		}
+		Chunk *chunk = finished[next_write % max_in_flight];
+		finished[next_write % max_in_flight] = NULL;
+		next_write++;
+		lock.unlock();
+		double t0 = wall_time();
+		write_outputs(*chunk, writers);
+		writer_stats.write_seconds += wall_time() - t0;
+		update_progress(progress, *chunk, binary);
+		if (checkpointer != NULL) {
+			checkpointer->chunk_written(*chunk, binary, writers);
+		}
+		lock.lock();
+		free_chunks[chunk->node].push_back(chunk);
+		cv_free.notify_one();
+	}
+	lock.unlock();
+	reader.join();
+	for (size_t tg = 0; tg < workers.size(); tg++) {
+		workers[tg].join();
+	}
+	writer_stats.cpu_seconds = cpu_time(CLOCK_THREAD_CPUTIME_ID) - start_thread_cpu;
+	stats.threads.insert(stats.threads.begin(), reader_stats);
+	stats.threads.push_back(writer_stats);
+	sort(stats.threads.begin() + 1, stats.threads.end() - 1, [](const ThreadStats &a, const ThreadStats &b) { return a.name.size() < b.name.size() || (a.name.size() == b.name.size() && a.name < b.name); });
+	stats.wall_seconds = wall_time() - start_time;
+	stats.cpu_seconds = cpu_time(CLOCK_PROCESS_CPUTIME_ID) - start_cpu;
+}
+
+// Sum the stage times and counters of all threads
+static ThreadStats total_stats(const RunStats &stats, size_t num_combos)
+{
+	ThreadStats total("total");
+	total.counts.assign(num_combos, AnalysisCounters());
+	for (size_t tg = 0; tg < stats.threads.size(); tg++) {
+		const ThreadStats &ts = stats.threads[tg];
+		total.bytes += ts.bytes;
+		total.lines += ts.lines;
+		total.sites_skipped += ts.sites_skipped;
+		total.read_seconds += ts.read_seconds;
+		total.parse_seconds += ts.parse_seconds;
+		total.compute_seconds += ts.compute_seconds;
+		total.format_seconds += ts.format_seconds;
+		total.write_seconds += ts.write_seconds;
+		total.cpu_seconds += ts.cpu_seconds;
+		total.tasks += ts.tasks;
+		total.tasks_stolen += ts.tasks_stolen;
+		for (size_t cg = 0; cg < ts.counts.size() && cg < num_combos; cg++) {
+			total.counts[cg].sites_analyzed += ts.counts[cg].sites_analyzed;
+			total.counts[cg].pops_below_min_Nc += ts.counts[cg].pops_below_min_Nc;
+			total.counts[cg].alleles_by_pol_test += ts.counts[cg].alleles_by_pol_test;
+			total.counts[cg].private_alleles += ts.counts[cg].private_alleles;
+			total.counts[cg].log_cache_lookups += ts.counts[cg].log_cache_lookups;
+			total.counts[cg].log_q_hits += ts.counts[cg].log_q_hits;
+		}
+		total.summaries.resize(num_combos);
+		for (size_t cg = 0; cg < ts.summaries.size() && cg < num_combos; cg++) {
+			vector <PopSummary> &sum = total.summaries[cg];
+			sum.resize( max( sum.size(), ts.summaries[cg].size() ) );
+			for (size_t ig = 0; ig < ts.summaries[cg].size(); ig++) {
+				const PopSummary &part = ts.summaries[cg][ig];
+				sum[ig].private_alleles += part.private_alleles;
+				sum[ig].expected_private_alleles += part.expected_private_alleles;
+				for (int bg = 0; bg < SUMMARY_FREQ_BINS; bg++) {
+					sum[ig].freq_hist[bg] += part.freq_hist[bg];
+				}
+				for (int bg = 0; bg < SUMMARY_LOG_PROB_BINS; bg++) {
+					sum[ig].log_prob_hist[bg] += part.log_prob_hist[bg];
+				}
+			}
+		}
+	}
+	return total;
+}
+
+// Print the statistics of the run in a human-readable form
+static void print_stats(FILE *stream, const RunStats &stats, const FPASweep &sweep)
+{
+	ThreadStats total = total_stats(stats, sweep.combos.size());
+	fprintf(stream, "Run statistics\n");
+	fprintf(stream, "	input bytes        %llu\n", (unsigned long long)total.bytes);
+	fprintf(stream, "	lines parsed       %llu\n", (unsigned long long)total.lines);
+	fprintf(stream, "	sites skipped      %llu (outside the region, or without a possible private allele; not counted below)\n", (unsigned long long)total.sites_skipped);
+	fprintf(stream, "	wall time          %.3f s (%.1f MB/s)\n", stats.wall_seconds, (stats.wall_seconds > 0.0) ? total.bytes/stats.wall_seconds/1e6 : 0.0);
+	fprintf(stream, "	CPU time           %.3f s\n", stats.cpu_seconds);
+	for (size_t cg = 0; cg < sweep.combos.size(); cg++) {
+		const AnalysisCounters &c = total.counts[cg];
+		fprintf(stream, "	min_Nc %g, cv %g: %llu sites with ne_pops >= 2, %llu populations below min_Nc, %llu alleles added by the polymorphism test, %llu private alleles\n", sweep.combos[cg].min_Nc, sweep.combos[cg].cv, (unsigned long long)c.sites_analyzed, (unsigned long long)c.pops_below_min_Nc, (unsigned long long)c.alleles_by_pol_test, (unsigned long long)c.private_alleles);
+		double lookups = (c.log_cache_lookups > 0) ? (double)c.log_cache_lookups : 1.0;
+		fprintf(stream, "	        log(1-p) cache: %llu lookups, %.1f%% hits\n", (unsigned long long)c.log_cache_lookups, 100.0*c.log_q_hits/lookups);
+	}
+	fprintf(stream, "	%-10s %12s %12s %9s %9s %9s %9s %9s %9s %7s %7s\n", "thread", "bytes", "lines", "read_s", "parse_s", "compute_s", "format_s", "write_s", "cpu_s", "tasks", "stolen");
+	for (size_t tg = 0; tg <= stats.threads.size(); tg++) {
+		const ThreadStats &ts = (tg < stats.threads.size()) ? stats.threads[tg] : total;
+		fprintf(stream, "	%-10s %12llu %12llu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %7llu %7llu\n", ts.name.c_str(), (unsigned long long)ts.bytes, (unsigned long long)ts.lines, ts.read_seconds, ts.parse_seconds, ts.compute_seconds, ts.format_seconds, ts.write_seconds, ts.cpu_seconds, (unsigned long long)ts.tasks, (unsigned long long)ts.tasks_stolen);
+	}
+}
+
+// Write the statistics of the run as a JSON object; returns false on failure
+static bool write_stats_json(const char *file_name, const RunStats &stats, const FPASweep &sweep)
+{
+	FILE *jsonstream = fopen(file_name, "w");
+	if (jsonstream == NULL) {
+		return false;
+	}
+	ThreadStats total = total_stats(stats, sweep.combos.size());
+	fprintf(jsonstream, "{\n  \"input_bytes\": %llu,\n  \"lines_parsed\": %llu,\n  \"sites_skipped\": %llu,\n  \"wall_seconds\": %.6f,\n  \"cpu_seconds\": %.6f,\n", (unsigned long long)total.bytes, (unsigned long long)total.lines, (unsigned long long)total.sites_skipped, stats.wall_seconds, stats.cpu_seconds);
+	fprintf(jsonstream, "  \"combinations\": [\n");
+	for (size_t cg = 0; cg < sweep.combos.size(); cg++) {
+		const AnalysisCounters &c = total.counts[cg];
+		fprintf(jsonstream, "    {\"min_Nc\": %.17g, \"cv\": %.17g, \"sites_analyzed\": %llu, \"pops_below_min_Nc\": %llu, \"alleles_by_pol_test\": %llu, \"private_alleles\": %llu, \"log_cache_lookups\": %llu, \"log_q_hits\": %llu}%s\n", sweep.combos[cg].min_Nc, sweep.combos[cg].cv, (unsigned long long)c.sites_analyzed, (unsigned long long)c.pops_below_min_Nc, (unsigned long long)c.alleles_by_pol_test, (unsigned long long)c.private_alleles, (unsigned long long)c.log_cache_lookups, (unsigned long long)c.log_q_hits, (cg + 1 < sweep.combos.size()) ? "," : "");
+	}
+	fprintf(jsonstream, "  ],\n  \"threads\": [\n");
+	for (size_t tg = 0; tg <= stats.threads.size(); tg++) {
+		const ThreadStats &ts = (tg < stats.threads.size()) ? stats.threads[tg] : total;
+		fprintf(jsonstream, "    {\"name\": \"%s\", \"bytes\": %llu, \"lines\": %llu, \"read_seconds\": %.6f, \"parse_seconds\": %.6f, \"compute_seconds\": %.6f, \"format_seconds\": %.6f, \"write_seconds\": %.6f, \"cpu_seconds\": %.6f, \"tasks\": %llu, \"tasks_stolen\": %llu}%s\n", ts.name.c_str(), (unsigned long long)ts.bytes, (unsigned long long)ts.lines, ts.read_seconds, ts.parse_seconds, ts.compute_seconds, ts.format_seconds, ts.write_seconds, ts.cpu_seconds, (unsigned long long)ts.tasks, (unsigned long long)ts.tasks_stolen, (tg < stats.threads.size()) ? "," : "");
+	}
+	fprintf(jsonstream, "  ]\n}\n");
+	return fclose(jsonstream) == 0;
+}
+
+// Write the summary of the private alleles of one combination of settings: a line for each population
+// analyzed, in the order of the input, and a last line for all of them
+static bool write_summary(const string &file_name, const vector <PopSummary> &summaries, const ColumnMap &columns)
+{
+	FILE *summarystream = fopen(file_name.c_str(), "w");
+	if (summarystream == NULL) {
+		return false;
+	}
+	fprintf(summarystream, "id_pop\tprivate_alleles\texpected_private_alleles");
+	for (int bg = 0; bg < SUMMARY_FREQ_BINS; bg++) {
+		fprintf(summarystream, "\tfocal_frequency_%.1f", (double)bg/SUMMARY_FREQ_BINS);
+	}
+	for (int bg = 0; bg < SUMMARY_LOG_PROB_BINS; bg++) {
+		fprintf(summarystream, "\tlog_prob_pa_%d", -bg);
+	}
+	fprintf(summarystream, "\n");
+	PopSummary all = {};
+	vector <PopSummary> rows(columns.pop_id.size() + 1);
+	for (size_t k = 0; k < columns.pop_id.size(); k++) {
+		if ( (size_t)columns.pop_id[k] < summaries.size() ) {
+			rows[k] = summaries[ columns.pop_id[k] ];
+		} else {	// nothing was analyzed
+			rows[k] = all;
+		}
+	}
+	for (size_t k = 0; k < columns.pop_id.size(); k++) {
+		all.private_alleles += rows[k].private_alleles;
+		all.expected_private_alleles += rows[k].expected_private_alleles;
+		for (int bg = 0; bg < SUMMARY_FREQ_BINS; bg++) {
+			all.freq_hist[bg] += rows[k].freq_hist[bg];
+		}
+		for (int bg = 0; bg < SUMMARY_LOG_PROB_BINS; bg++) {
+			all.log_prob_hist[bg] += rows[k].log_prob_hist[bg];
+		}
+	}
+	rows.back() = all;
+	for (size_t k = 0; k < rows.size(); k++) {
+		if (k < columns.pop_id.size()) {
+			fprintf(summarystream, "%d", columns.pop_id[k]);
+		} else {
+			fprintf(summarystream, "all");
+		}
+		fprintf(summarystream, "\t%llu\t%f", (unsigned long long)rows[k].private_alleles, rows[k].expected_private_alleles);
+		for (int bg = 0; bg < SUMMARY_FREQ_BINS; bg++) {
+			fprintf(summarystream, "\t%llu", (unsigned long long)rows[k].freq_hist[bg]);
+		}
+		for (int bg = 0; bg < SUMMARY_LOG_PROB_BINS; bg++) {
+			fprintf(summarystream, "\t%llu", (unsigned long long)rows[k].log_prob_hist[bg]);
+		}
+		fprintf(summarystream, "\n");
+	}
+	return fclose(summarystream) == 0;
+}
+
+// Parameters of the synthetic input made by -synth, and by -bench and -selftest of FPA_check
+struct SynthParams {
+	int num_pops;		// number of populations
+	long num_sites;		// number of sites
+	double na_rate;		// probability that a population has no data at a site
+	double poly_rate;	// probability that a site is polymorphic
+	double min_Nc, max_Nc;	// range of the uniformly distributed Nc
+	unsigned int seed;	// seed of the random number generator
+};
+
+// Generate synthetic input in the combined GFE p-mode layout, header included: scaffold, site and
+// reference nucleotide, then nine columns per population.  At a polymorphic site each population with
+// data carries the minor allele with probability 0.3, so that private alleles are common.
+static void generate_synthetic(const SynthParams &sp, string &text)
+{
+	mt19937_64 rng(sp.seed);
+	uniform_real_distribution <double> unif(0.0, 1.0);
+	char buf[256];
+	text.clear();
+	text += "scaffold\tsite\tref_nuc";
+	for (int pg = 1; pg <= sp.num_pops; pg++) {
+		text += "\tmajor_allele\tminor_allele\tpop_coverage\tNc\tbest_p\tbest_q\tbest_error\tbest_H\tpol_llstat";
+	}
+	text += "\n";
+	const long sites_per_scaffold = 1000000;
+	for (long sg = 0; sg < sp.num_sites; sg++) {
+		char ref = allele_chars[rng() % 4];
+		char alt = allele_chars[(strchr(allele_chars, ref) - allele_chars + 1 + rng() % 3) % 4];
+		bool poly = ( unif(rng) < sp.poly_rate );
+		snprintf(buf, sizeof(buf), "scaffold_%ld\t%ld\t%c", sg/sites_per_scaffold + 1, sg%sites_per_scaffold + 1, ref);
+		text += buf;
+		for (int pg = 1; pg <= sp.num_pops; pg++) {
+			double Nc = sp.min_Nc + (sp.max_Nc - sp.min_Nc)*unif(rng);
+			int cov = (int)(Nc*1.5 + 10.0*unif(rng));
+			if ( unif(rng) < sp.na_rate ) {
+				snprintf(buf, sizeof(buf), "\tNA\tNA\t%d\tNA\tNA\tNA\tNA\tNA\tNA", cov/4);
+			} else if ( poly && unif(rng) < 0.3 ) {
+				double q = 0.5*unif(rng);
+				snprintf(buf, sizeof(buf), "\t%c\t%c\t%d\t%f\t%f\t%f\t%f\t%f\t%f", ref, alt, cov, Nc, 1.0 - q, q, 0.01*unif(rng), 2.0*q*(1.0 - q), 50.0*unif(rng));
+			} else {
+				snprintf(buf, sizeof(buf), "\t%c\tNA\t%d\t%f\t1.000000\t0.000000\t%f\t0.000000\tNA", ref, cov, Nc, 0.01*unif(rng));
+			}
+			text += buf;
+		}
+		text += "\n";
+	}
+}
+
+#ifdef FPA_CHECK
+#include "FPA_check.h"		// -bench and -selftest, built into FPA_check by make check
+#endif
+
+// Parse a comma-separated list of numbers; returns false when an element is not a number
+static bool parse_list(const char *text, vector <double> &values)
+{
+	values.clear();
+	const char *p = text;
+	while (true) {
+		char *end;
+		double value = strtod(p, &end);
+		if (end == p) {
+			return false;
+		}
+		values.push_back(value);
+		if (*end == '\0') {
+			return true;
+		}
+		if (*end != ',') {
+			return false;
+		}
+		p = end + 1;
+	}
+}
+
+// Insert tag into a file name before its extensions, e.g. Out_FPA.txt.gz -> Out_FPA<tag>.txt.gz
+static string tagged_file_name(const char *file_name, const char *tag)
+{
+	string name(file_name);
+	size_t slash = name.rfind('/');
+	size_t dot = name.find('.', (slash == string::npos) ? 0 : slash + 1);
+	if (dot == string::npos) {
+		dot = name.size();
+	}
+	return name.substr(0, dot) + tag + name.substr(dot);
+}
+
+// Name of the output file of one combination of settings in a sweep: the settings, with the given number
+// of significant digits, are inserted before the extensions of the name, e.g. Out_FPA_minNc20_cv5.991.txt
+static string combo_file_name(const char *out_file_name, double min_Nc, double cv, int digits)
+{
+	char tag[96];
+	snprintf(tag, sizeof(tag), "_minNc%.*g_cv%.*g", digits, min_Nc, digits, cv);
+	return tagged_file_name(out_file_name, tag);
+}
+
+// Names of the output files of a sweep over the -min_Nc and -cv values, in the order of the combinations
+// (min_Nc, then cv); just out_file_name without a sweep.  The settings are written with 6 significant
+// digits, or with as many more as it takes for the names to differ.  The values must not repeat.
+static vector <string> combo_file_names(const char *out_file_name, const vector <double> &min_Nc, const vector <double> &cv)
+{
+	vector <string> names;
+	if (min_Nc.size()*cv.size() == 1) {
+		names.push_back( string(out_file_name) );
+		return names;
+	}
+	for (int digits = 6; digits <= 17; digits++) {
+		names.clear();
+		for (size_t ig = 0; ig < min_Nc.size(); ig++) {
+			for (size_t jg = 0; jg < cv.size(); jg++) {
+				names.push_back( combo_file_name(out_file_name, min_Nc[ig], cv[jg], digits) );
+			}
+		}
+		vector <string> sorted_names = names;
+		sort(sorted_names.begin(), sorted_names.end());
+		if ( adjacent_find(sorted_names.begin(), sorted_names.end()) == sorted_names.end() ) {
+			break;
+		}
+	}
+	return names;
+}
+
+// Name of the checkpoint file of a run: the -out name + .ckpt, also for a sweep, for which the names of the
+// output files differ from it
+static string checkpoint_file_name(const char *out_file_name)
+{
+	return string(out_file_name) + ".ckpt";
+}
+
+// Name of the output file of shard k of n, e.g. Out_FPA_shard3of8.txt
+static string shard_file_name(const char *out_file_name, int shard, int num_shards)
+{
+	char tag[64];
+	snprintf(tag, sizeof(tag), "_shard%dof%d", shard, num_shards);
+	return tagged_file_name(out_file_name, tag);
+}
+
+// Shard of the input for a run on its own machine: whole scaffold runs of the index, [first, end)
+struct Shard {
+	size_t first, end;	// entries of the index
+	uint64_t begin_offset, end_offset;	// byte range of the input
+};
+
+// Split the input described by the index into num_shards shards of about the same number of bytes.
+// Shards are cut only between the entries of the index, so a scaffold is never split; with fewer
+// scaffolds than shards, or one scaffold much larger than the others, some shards are empty.
+static vector <Shard> split_shards(const vector <IndexEntry> &index, int num_shards, uint64_t data_begin)
+{
+	vector <Shard> shards(num_shards);
+	uint64_t first_offset = index.empty() ? data_begin : index.front().begin;
+	uint64_t total = index.empty() ? 0 : index.back().end - first_offset;
+	size_t ig = 0;
+	for (int k = 0; k < num_shards; k++) {
+		uint64_t target = first_offset + total*(k + 1)/num_shards;	// where the shard should end
+		shards[k].first = ig;
+		while ( ig < index.size() && ( k + 1 == num_shards || index[ig].end <= target || (ig == shards[k].first && index[ig].begin < target) ) ) {
+			ig++;
+		}
+		shards[k].end = ig;
+		shards[k].begin_offset = (k > 0) ? shards[k - 1].end_offset : first_offset;
+		shards[k].end_offset = (ig > shards[k].first) ? index[ig - 1].end : shards[k].begin_offset;
+	}
+	return shards;
+}
+
+// Write the manifest of the shards: a line identifying the input, then for each shard its number, byte
+// range, scaffolds and the output file that its run writes and -merge reads
+static bool write_shard_manifest(const string &manifest_name, const vector <Shard> &shards, const vector <IndexEntry> &index, const char *out_file_name, uint64_t in_size, int64_t in_mtime)
+{
+	FILE *manifeststream = fopen(manifest_name.c_str(), "w");
+	if (manifeststream == NULL) {
+		return false;
+	}
+	int num_shards = (int)shards.size();
+	fprintf(manifeststream, "#FPA_shards\t%d\t%llu\t%lld\n", num_shards, (unsigned long long)in_size, (long long)in_mtime);
+	fprintf(manifeststream, "#shard\tbegin\tend\tscaffolds\tfirst_scaffold\tlast_scaffold\toutput\n");
+	for (int k = 0; k < num_shards; k++) {
+		const Shard &shard = shards[k];
+		bool empty = (shard.end == shard.first);
+		fprintf(manifeststream, "%d/%d\t%llu\t%llu\t%zu\t%s\t%s\t%s\n", k + 1, num_shards, (unsigned long long)shard.begin_offset, (unsigned long long)shard.end_offset, shard.end - shard.first, empty ? "-" : index[shard.first].scaffold.c_str(), empty ? "-" : index[shard.end - 1].scaffold.c_str(), shard_file_name(out_file_name, k + 1, num_shards).c_str());
+	}
+	return fclose(manifeststream) == 0;
+}
+
+// Read the output files of the shards, in order, from a manifest
+static bool read_shard_manifest(const string &manifest_name, vector <string> &outputs)
+{
+	ifstream manifestFile(manifest_name);
+	string line, tag;
+	int num_shards;
+	if ( !getline(manifestFile, line) ) {
+		return false;
+	}
+	istringstream hs(line);
+	if ( !(hs >> tag >> num_shards) || tag != "#FPA_shards" ) {
+		return false;
+	}
+	outputs.clear();
+	vector <string_view> fields;
+	while ( getline(manifestFile, line) ) {
+		if ( line.empty() || line[0] == '#' ) {
+			continue;
+		}
+		split_fields(line, fields, 7);
+		if ( fields[6].empty() ) {
+			return false;
+		}
+		outputs.push_back( string(fields[6]) );
+	}
+	return (int)outputs.size() == num_shards;
+}
+
+// Concatenate the outputs of the shards into out_name, keeping the header line of the first only
+static bool merge_shard_outputs(const vector <string> &outputs, const string &out_name)
+{
+	FILE *outstream = fopen(out_name.c_str(), "w");
+	if (outstream == NULL) {
+		fprintf(stderr, "Cannot open %s for writing.\n", out_name.c_str());
+		return false;
+	}
+	vector <char> buffer((size_t)4 << 20);
+	bool write_ok = true;
+	for (size_t sg = 0; sg < outputs.size() && write_ok; sg++) {
+		FILE *shardstream = fopen(outputs[sg].c_str(), "r");
+		if (shardstream == NULL) {
+			fprintf(stderr, "Cannot open %s for reading.\n", outputs[sg].c_str());
+			fclose(outstream);
+			return false;
+		}
+		bool in_header = (sg > 0);
+		size_t n;
+		while ( write_ok && (n = fread(buffer.data(), 1, buffer.size(), shardstream)) > 0 ) {
+			const char *data = buffer.data();
+			if (in_header) {
+				const char *nl = (const char *)memchr(data, '\n', n);
+				size_t skip = (nl != NULL) ? (size_t)(nl - data) + 1 : n;
+				in_header = (nl == NULL);
+				data += skip;
+				n -= skip;
+			}
+			write_ok = ( fwrite(data, 1, n, outstream) == n );
+		}
+		bool read_ok = !ferror(shardstream);
+		fclose(shardstream);
+		if (!read_ok) {
+			fprintf(stderr, "Error reading %s.\n", outputs[sg].c_str());
+			fclose(outstream);
+			return false;
+		}
+	}
+	if ( fclose(outstream) != 0 || !write_ok ) {
+		fprintf(stderr, "Error writing to %s.\n", out_name.c_str());
+		return false;
+	}
+	return true;
+}
+
 int main(int argc, char *argv[])
 {
 	// Default values of the options
 	const char* in_file_name = {"In_FPA.txt"};
 	const char* out_file_name = {"Out_FPA.txt"};
-	double min_Nc = 20.0;
-	double cv = 5.991;
+	vector <double> min_Nc(1, 20.0);
+	vector <double> cv(1, 5.991);
+	int use_mmap = 1;
+	int num_threads = 1;
+	int use_numa = 0;
+	const char* region = NULL;
+	const char* index_file_name = NULL;
+	const char* convert_file_name = NULL;
+	int make_shards = 0;
+	int shard = 0, num_shards = 0;
+	int merge_shards = 0;
+	const char* synth_file_name = NULL;
+#ifdef FPA_CHECK
+	int run_bench = 0;
+	int run_self_test = 0;
+	const char* baseline_name = NULL;
+	int write_baseline = 0;
+#endif
+	SynthParams synth = {10, 100000, 0.1, 0.1, 10.0, 60.0, 1};
+	vector <double> synth_Nc;
+	int print_stats_report = 0;
+	const char* stats_json_name = NULL;
+	const char* summary_name = NULL;
+	double progress_interval = 0.0;
+	const char* progress_file_name = NULL;
+	double checkpoint_interval = 0.0;
+	int resume = 0;
+	const char* pops = NULL;
+	const char* pops_file_name = NULL;
+	const char* in_pops = NULL;
+	const char* in_pops_list = NULL;
 	int print_help = 0;
 	
 	int argz = 1; // argument counter
@@ -44,12 +2630,96 @@ int main(int argc, char *argv[])
 			print_help = 1;
 		} else if (strcmp(argv[argz], "-in") == 0) {
 			in_file_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-in_pops") == 0) {
+			in_pops = argv[++argz];
+		} else if (strcmp(argv[argz], "-in_pops_list") == 0) {
+			in_pops_list = argv[++argz];
 		} else if (strcmp(argv[argz], "-out") == 0) {
 			out_file_name = argv[++argz];
 		} else if (strcmp(argv[argz], "-min_Nc") == 0) {
-			sscanf(argv[++argz], "%lf", &min_Nc);
+			if ( !parse_list(argv[++argz], min_Nc) ) {
+				fprintf(stderr, "Invalid value of -min_Nc: %s\n", argv[argz]);
+				print_help = 1;
+				break;
+			}
 		} else if (strcmp(argv[argz], "-cv") == 0) {
-			sscanf(argv[++argz], "%lf", &cv);
+			if ( !parse_list(argv[++argz], cv) ) {
+				fprintf(stderr, "Invalid value of -cv: %s\n", argv[argz]);
+				print_help = 1;
+				break;
+			}
+		} else if (strcmp(argv[argz], "-mmap") == 0) {
+			sscanf(argv[++argz], "%d", &use_mmap);
+		} else if (strcmp(argv[argz], "-threads") == 0) {
+			sscanf(argv[++argz], "%d", &num_threads);
+		} else if (strcmp(argv[argz], "-numa") == 0) {
+			sscanf(argv[++argz], "%d", &use_numa);
+		} else if (strcmp(argv[argz], "-pops") == 0) {
+			pops = argv[++argz];
+		} else if (strcmp(argv[argz], "-pops_file") == 0) {
+			pops_file_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-region") == 0) {
+			region = argv[++argz];
+		} else if (strcmp(argv[argz], "-index") == 0) {
+			index_file_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-convert") == 0) {
+			convert_file_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-shards") == 0) {
+			sscanf(argv[++argz], "%d", &make_shards);
+		} else if (strcmp(argv[argz], "-shard") == 0) {
+			char tail;
+			if ( sscanf(argv[++argz], "%d/%d%c", &shard, &num_shards, &tail) != 2 || shard < 1 || shard > num_shards ) {
+				fprintf(stderr, "Invalid value of -shard: %s\n", argv[argz]);
+				print_help = 1;
+				break;
+			}
+		} else if (strcmp(argv[argz], "-merge") == 0) {
+			merge_shards = 1;
+		} else if (strcmp(argv[argz], "-stats") == 0) {
+			print_stats_report = 1;
+		} else if (strcmp(argv[argz], "-stats_json") == 0) {
+			stats_json_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-summary") == 0) {
+			summary_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-progress") == 0) {
+			sscanf(argv[++argz], "%lf", &progress_interval);
+		} else if (strcmp(argv[argz], "-progress_file") == 0) {
+			progress_file_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-checkpoint") == 0) {
+			sscanf(argv[++argz], "%lf", &checkpoint_interval);
+		} else if (strcmp(argv[argz], "-resume") == 0) {
+			resume = 1;
+#ifdef FPA_CHECK
+		} else if (strcmp(argv[argz], "-bench") == 0) {
+			run_bench = 1;
+		} else if (strcmp(argv[argz], "-selftest") == 0) {
+			run_self_test = 1;
+		} else if (strcmp(argv[argz], "-baseline") == 0) {
+			baseline_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-write_baseline") == 0) {
+			baseline_name = argv[++argz];
+			write_baseline = 1;
+#endif
+		} else if (strcmp(argv[argz], "-synth") == 0) {
+			synth_file_name = argv[++argz];
+		} else if (strcmp(argv[argz], "-synth_pops") == 0) {
+			sscanf(argv[++argz], "%d", &synth.num_pops);
+		} else if (strcmp(argv[argz], "-synth_sites") == 0) {
+			sscanf(argv[++argz], "%ld", &synth.num_sites);
+		} else if (strcmp(argv[argz], "-synth_na") == 0) {
+			sscanf(argv[++argz], "%lf", &synth.na_rate);
+		} else if (strcmp(argv[argz], "-synth_poly") == 0) {
+			sscanf(argv[++argz], "%lf", &synth.poly_rate);
+		} else if (strcmp(argv[argz], "-synth_Nc") == 0) {
+			if ( !parse_list(argv[++argz], synth_Nc) || synth_Nc.size() != 2 ) {
+				fprintf(stderr, "Invalid value of -synth_Nc: %s\n", argv[argz]);
+				print_help = 1;
+				break;
+			}
+			synth.min_Nc = synth_Nc[0];
+			synth.max_Nc = synth_Nc[1];
+		} else if (strcmp(argv[argz], "-synth_seed") == 0) {
+			sscanf(argv[++argz], "%u", &synth.seed);
 		} else {
 			fprintf(stderr, "unknown option %s\n", argv[argz]);
 			print_help = 1;
@@ -61,17 +2731,159 @@ int main(int argc, char *argv[])
 		fprintf(stderr, "USAGE: %s {<options>}\n", argv[0]);
 		fprintf(stderr, "	options:\n");
 		fprintf(stderr, "	-h: print the usage message\n");
-		fprintf(stderr, "	-in <s>: specify the input file name\n");
-		fprintf(stderr, "       -out <s>: specify the output file name\n");
+		fprintf(stderr, "	-in <s>: specify the input file name (gzip, bgzip and zstd files are decompressed on the fly)\n");
+		fprintf(stderr, "       -out <s>: specify the output file name (names ending in .gz or .bgz are written with bgzip, .zst with zstd)\n");
+		fprintf(stderr, "	        Use - for -in or -out to read the input from stdin or write the output to stdout.\n");
+		fprintf(stderr, "	-in_pops <s>: read the comma-separated per-population GFE p-mode files and merge them on scaffold and site instead of -in\n");
+		fprintf(stderr, "	-in_pops_list <s>: read the per-population files listed in the given file, one per line\n");
 		fprintf(stderr, "	-min_Nc <f>: specify the minimum effective number of sampled chromosomes required in a deme\n");
 		fprintf(stderr, "       -cv <f>: specify the chi-square critical value for the polymorphism test\n");
+		fprintf(stderr, "	        Comma-separated lists of -min_Nc and -cv values are all analyzed in a single pass, each combination\n");
+		fprintf(stderr, "	        written to its own output file named after the settings, e.g. Out_FPA_minNc20_cv5.991.txt\n");
+		fprintf(stderr, "	-mmap <d>: memory-map the input file when possible (1) or always read it as a stream (0)\n");
+		fprintf(stderr, "	-threads <d>: specify the number of threads analyzing the sites\n");
+		fprintf(stderr, "	-numa <d>: spread the threads over the NUMA nodes, pinned to their CPUs, with the buffers of each\n");
+		fprintf(stderr, "	        thread on its node (1), or leave the placement to the system (0, default)\n");
+		fprintf(stderr, "	-pops <s>: analyze only the populations of a comma-separated list of names (the suffix of the header labels,\n");
+		fprintf(stderr, "	        e.g. Kenya for major_allele_Kenya) or numbers from 1; id_pop keeps the number of the population in the input\n");
+		fprintf(stderr, "	-pops_file <s>: analyze only the populations listed in the given file, one name or number per line\n");
+		fprintf(stderr, "	-region <s>: analyze only the sites of a region given as scaffold[:start-end]\n");
+		fprintf(stderr, "	-index <s>: specify the name of the scaffold index used with -region (default: input file name + .fpai)\n");
+		fprintf(stderr, "	-convert <s>: convert the input to a binary columnar file of the given name, which can be given to -in for faster analysis\n");
+		fprintf(stderr, "	-shards <d>: split the input into the given number of shards of whole scaffolds, for runs on separate machines,\n");
+		fprintf(stderr, "	        and write their byte ranges and output files to the manifest named after the output file + .shards\n");
+		fprintf(stderr, "	-shard <k/n>: analyze only shard k of n, writing to the output file name with _shard<k>of<n> inserted\n");
+		fprintf(stderr, "	-merge: concatenate the outputs of the shards listed in the manifest of the output file into it, in input order\n");
+		fprintf(stderr, "	-stats: print the bytes, lines, sites and alleles counted and the time of each stage and thread to stderr\n");
+		fprintf(stderr, "	-stats_json <s>: also write these statistics as JSON to the given file\n");
+		fprintf(stderr, "	-summary <s>: write to the given file, for each id_pop, the number of private alleles, their expected number (the sum\n");
+		fprintf(stderr, "	        of their probabilities) and histograms of focal_frequency (bins of 0.1 named by their lower bound) and of\n");
+		fprintf(stderr, "	        log_prob_pa (bins of 1 named by their upper bound, the last one open); a sweep writes one file per combination\n");
+		fprintf(stderr, "	-progress <f>: report the scaffold, the sites and bytes processed, the speed and the ETA every given number of seconds\n");
+		fprintf(stderr, "	-progress_file <s>: write the progress reports to the given status file instead of stderr (default interval: 10 s)\n");
+		fprintf(stderr, "	-checkpoint <f>: save the input offset and the output file sizes to the output file name + .ckpt every given number of seconds\n");
+		fprintf(stderr, "	-resume: truncate the output to the last checkpoint and continue the run from there (checkpoints every 60 s unless -checkpoint is given)\n");
+#ifdef FPA_CHECK
+		fprintf(stderr, "	-bench: time the parse, compute and output stages on synthetic input and validate the output against the reference implementation\n");
+		fprintf(stderr, "	-selftest: check edge cases and a synthetic input against the reference implementation, the binary input and the threaded\n");
+		fprintf(stderr, "	        pipeline (-threads), then measure the throughput; the exit status is 1 when a check fails\n");
+		fprintf(stderr, "	-baseline <s>: also fail the self-test when a throughput is more than 40%% below the one in the given baseline file,\n");
+		fprintf(stderr, "	        where a passing run adds the throughputs of the configurations not yet in it\n");
+		fprintf(stderr, "	-write_baseline <s>: write the throughputs of a passing self-test to the given baseline file\n");
+#endif
+		fprintf(stderr, "	-synth <s>: write synthetic input to the given file instead of analyzing\n");
+		fprintf(stderr, "	-synth_pops <d>, -synth_sites <d>: specify the numbers of populations and sites of the synthetic input (default: 10, 100000)\n");
+		fprintf(stderr, "	-synth_na <f>, -synth_poly <f>: specify the rates of missing data and polymorphic sites of the synthetic input (default: 0.1, 0.1)\n");
+		fprintf(stderr, "	-synth_Nc <f,f>: specify the range of Nc of the synthetic input (default: 10,60)\n");
+		fprintf(stderr, "	-synth_seed <d>: specify the random seed of the synthetic input\n");
 		exit(1);
 	}
 
-	string line; // String buffer
+	// Each combination of a sweep writes its own output file, so the values must not repeat
+	for (size_t ig = 0; ig < min_Nc.size(); ig++) {
+		if ( find(min_Nc.begin(), min_Nc.begin() + ig, min_Nc[ig]) != min_Nc.begin() + ig ) {
+			fprintf(stderr, "-min_Nc lists %g more than once.\n", min_Nc[ig]);
+			exit(1);
+		}
+	}
+	for (size_t ig = 0; ig < cv.size(); ig++) {
+		if ( find(cv.begin(), cv.begin() + ig, cv[ig]) != cv.begin() + ig ) {
+			fprintf(stderr, "-cv lists %g more than once.\n", cv[ig]);
+			exit(1);
+		}
+	}
+
+	// Synthetic input and benchmark modes
+	if (synth_file_name != NULL) {
+		string text;
+		generate_synthetic(synth, text);
+		FILE *synthstream = fopen(synth_file_name, "w");
+		if ( synthstream == NULL || fwrite(text.data(), 1, text.size(), synthstream) != text.size() || fclose(synthstream) != 0 ) {
+			fprintf(stderr, "Error writing to %s.\n", synth_file_name);
+			exit(1);
+		}
+		return 0;
+	}
+#ifdef FPA_CHECK
+	if (run_bench) {
+		FPAConfig bench_config = {};
+		bench_config.min_Nc = min_Nc[0];
+		bench_config.cv = cv[0];
+		return run_benchmark(synth, bench_config, num_threads);
+	}
+	if (run_self_test) {
+		return run_selftest(num_threads, baseline_name, write_baseline != 0);
+	}
+#endif
+
+	// Merge the outputs of the shards listed in the manifest of the output file, for each combination of settings
+	if (merge_shards) {
+		string manifest_name = string(out_file_name) + ".shards";
+		vector <string> outputs;
+		if ( !read_shard_manifest(manifest_name, outputs) ) {
+			fprintf(stderr, "Cannot read the shard manifest %s.\n", manifest_name.c_str());
+			exit(1);
+		}
+		vector <string> out_names = combo_file_names(out_file_name, min_Nc, cv);
+		vector < vector <string> > shard_names;	// for each shard, the names of its outputs
+		for (size_t sg = 0; sg < outputs.size(); sg++) {
+			string checkpoint_name = checkpoint_file_name( outputs[sg].c_str() );
+			if ( access(checkpoint_name.c_str(), F_OK) == 0 ) {
+				fprintf(stderr, "The run of %s has not finished: its checkpoint %s is still there.\n", outputs[sg].c_str(), checkpoint_name.c_str());
+				exit(1);
+			}
+			shard_names.push_back( combo_file_names(outputs[sg].c_str(), min_Nc, cv) );
+		}
+		for (size_t cg = 0; cg < out_names.size(); cg++) {
+			const char *missing_tool;
+			if ( !compress_command(out_names[cg].c_str(), 1, missing_tool).empty() || missing_tool != NULL ) {
+				fprintf(stderr, "-merge writes uncompressed output files only.\n");
+				exit(1);
+			}
+			vector <string> combo_outputs;
+			for (size_t sg = 0; sg < outputs.size(); sg++) {
+				combo_outputs.push_back( shard_names[sg][cg] );
+			}
+			if ( !merge_shard_outputs(combo_outputs, out_names[cg]) ) {
+				exit(1);
+			}
+			fprintf(stdout, "Merged %zu shards into %s\n", outputs.size(), out_names[cg].c_str());
+		}
+		return 0;
+	}
+
+	string_view line; // Current line of the input file
 	
-	ifstream inputFile(in_file_name); // Try to open the input file
-	if ( !inputFile.is_open() ) { // Exit on failure
+	InputReader inputFile; // Try to open the input file
+	string in_pops_names;	// file names given by -in_pops and -in_pops_list
+	if (in_pops != NULL || in_pops_list != NULL) {
+		in_pops_names = (in_pops != NULL) ? string(in_pops) : string();
+		if (in_pops_list != NULL) {
+			ifstream listfile(in_pops_list);
+			if ( !listfile ) {
+				fprintf(stderr, "Cannot open %s for reading.\n", in_pops_list);
+				exit(1);
+			}
+			string name;
+			while ( getline(listfile, name) ) {
+				if ( !name.empty() ) {
+					in_pops_names += (in_pops_names.empty() ? "" : ",") + name;
+				}
+			}
+		}
+		vector <string> file_names;
+		for (size_t begin = 0, end; begin < in_pops_names.size(); begin = end + 1) {
+			end = min(in_pops_names.find(',', begin), in_pops_names.size());
+			if (end > begin) {
+				file_names.push_back( in_pops_names.substr(begin, end - begin) );
+			}
+		}
+		if ( file_names.empty() || !inputFile.open_merged(file_names, use_mmap != 0) ) {
+			fprintf(stderr, "Cannot merge the per-population files %s.\n", in_pops_names.c_str());
+			exit(1);
+		}
+		in_file_name = in_pops_names.c_str();
+	} else if ( !inputFile.open(in_file_name, use_mmap != 0, num_threads) ) { // Exit on failure
 		fprintf(stderr, "Cannot open %s for reading.\n", in_file_name);
 		exit(1);
 	}
@@ -79,8 +2891,11 @@ int main(int argc, char *argv[])
 	// Read the header
 	string h_scaf, h_site, h_ref_nuc;
 	vector <string> pop_info; // Stores population-specific labels.
-	getline(inputFile, line);
-	istringstream ss(line);
+	if ( !inputFile.next_line(line) ) {
+		line = string_view();
+	}
+	string header(line);	// kept for -convert
+	istringstream ss(header);
 	ss >> h_scaf >> h_site >> h_ref_nuc;
 	string str; // Temporarily stores population-specific labels
 	pop_info.clear();
@@ -91,143 +2906,299 @@ int main(int argc, char *argv[])
 			break;
 		}
 	}
-	int num_pops = (int)pop_info.size()/9;
-	printf("%d populations to be analyzed\n", num_pops);
+	int num_pops;
+	ColumnMap columns;
+	if ( !build_column_map(pop_info, num_pops, columns) && !line.empty() ) {
+		fprintf(stderr, "The population columns of the header are not recognized; assuming the nine columns per population of GFE.\n");
+	}
+
+	// Select the populations to be analyzed; the columns of the others are neither split nor converted
+	ColumnMap pop_columns = columns;
+	if (pops != NULL || pops_file_name != NULL) {
+		string list = (pops != NULL) ? string(pops) : string();
+		if (pops_file_name != NULL) {
+			ifstream popsfile(pops_file_name);
+			if ( !popsfile ) {
+				fprintf(stderr, "Cannot open %s for reading.\n", pops_file_name);
+				exit(1);
+			}
+			list += "\n" + string( (istreambuf_iterator <char> (popsfile)), istreambuf_iterator <char> () );
+		}
+		vector <int> ids;
+		string unknown;
+		if ( !parse_populations(list, population_names(pop_info, columns), ids, unknown) ) {
+			fprintf(stderr, "Unknown population %s in -pops\n", unknown.c_str());
+			exit(1);
+		}
+		if ( ids.empty() ) {
+			fprintf(stderr, "No population is selected by -pops.\n");
+			exit(1);
+		}
+		select_populations(pop_columns, ids);
+	}
+	int num_analyzed = (int)pop_columns.pop_id.size();
+	bool out_stdout = (strcmp(out_file_name, "-") == 0);
+	fprintf(out_stdout ? stderr : stdout, "%d populations to be analyzed\n", num_analyzed);	// keep stdout for the results when they go there
+
+	// Restrict the input to the requested region
+	string region_scaffold;
+	int region_start = 0, region_end = INT_MAX;
+	if (region != NULL) {
+		if ( !parse_region(region, region_scaffold, region_start, region_end) ) {
+			fprintf(stderr, "Invalid region %s\n", region);
+			exit(1);
+		}
+		if ( inputFile.is_regular() && !inputFile.is_binary() && strcmp(in_file_name, "-") != 0 ) {	// Seek to the scaffold with the index, building it on the first use
+			string index_name = (index_file_name != NULL) ? string(index_file_name) : string(in_file_name) + ".fpai";
+			vector <IndexEntry> index;
+			load_index(in_file_name, index_name, inputFile, index);
+			uint64_t begin = UINT64_MAX, end = 0;
+			for (size_t ig = 0; ig < index.size(); ig++) {
+				if ( index[ig].scaffold == region_scaffold && !(index[ig].last_site < region_start || index[ig].first_site > region_end) ) {
+					begin = min(begin, index[ig].begin);
+					end = max(end, index[ig].end);
+				}
+			}
+			if (begin == UINT64_MAX) {	// No site of the region in the input
+				begin = end = inputFile.offset();
+			}
+			inputFile.set_range(begin, end);
+		}
+	}
+
+	// Split the input into shards, or restrict it to one of them
+	string shard_out_name;
+	if (make_shards > 0 || num_shards > 0) {
+		if ( !inputFile.is_regular() || inputFile.is_binary() || strcmp(in_file_name, "-") == 0 || region != NULL || out_stdout ) {
+			fprintf(stderr, "-shards and -shard need a text input file and an output file, and cannot be combined with -region.\n");
+			exit(1);
+		}
+		string index_name = (index_file_name != NULL) ? string(index_file_name) : string(in_file_name) + ".fpai";
+		vector <IndexEntry> index;
+		load_index(in_file_name, index_name, inputFile, index);
+		vector <Shard> shards = split_shards(index, (make_shards > 0) ? make_shards : num_shards, inputFile.offset());
+		if (make_shards > 0) {
+			string manifest_name = string(out_file_name) + ".shards";
+			if ( !write_shard_manifest(manifest_name, shards, index, out_file_name, inputFile.size(), inputFile.mtime()) ) {
+				fprintf(stderr, "Error writing to %s.\n", manifest_name.c_str());
+				exit(1);
+			}
+			fprintf(stdout, "Wrote the manifest of %d shards to %s; run each with -shard <k>/%d\n", make_shards, manifest_name.c_str(), make_shards);
+			return 0;
+		}
+		inputFile.set_range(shards[shard - 1].begin_offset, shards[shard - 1].end_offset);
+		shard_out_name = shard_file_name(out_file_name, shard, num_shards);
+		out_file_name = shard_out_name.c_str();
+	}
 
-	FILE *outstream;
+	// Convert the input to the binary columnar format instead of analyzing it
+	if (convert_file_name != NULL) {
+		if ( inputFile.is_binary() ) {
+			fprintf(stderr, "%s is already a binary columnar file.\n", in_file_name);
+			exit(1);
+		}
+		FPAConfig config;
+		config.num_pops = num_pops;
+		config.columns = columns;
+		config.min_Nc = min_Nc[0];
+		config.cv = cv[0];
+		config.reject_sites = false;
+		config.use_region = false;
+		if ( !convert_input(inputFile, header, config, convert_file_name) ) {
+			exit(1);
+		}
+		if ( !inputFile.close() ) {
+			fprintf(stderr, "Error reading %s.\n", in_file_name);
+			exit(1);
+		}
+		return 0;
+	}
 
-	// Open the output file
-	outstream = fopen(out_file_name, "w");
-	if (outstream == NULL ) { // Exit on failure
-		fprintf(stderr, "Cannot open %s for writing.\n", out_file_name); 
+	// Settings of each combination of -min_Nc and -cv values
+	FPASweep sweep;
+	FPAConfig config;
+	config.num_pops = num_analyzed;
+	config.columns = pop_columns;
+	config.reject_sites = true;
+	config.use_region = (region != NULL);
+	config.region_scaffold = region_scaffold;
+	config.region_start = region_start;
+	config.region_end = region_end;
+	for (size_t ig = 0; ig < min_Nc.size(); ig++) {
+		for (size_t jg = 0; jg < cv.size(); jg++) {
+			config.min_Nc = min_Nc[ig];
+			config.cv = cv[jg];
+			sweep.combos.push_back(config);
+		}
+	}
+	sweep.parse = sweep.combos[0];
+	sweep.parse.min_Nc = *min_element(min_Nc.begin(), min_Nc.end());
+	sweep.summarize = (summary_name != NULL);
+	size_t num_combos = sweep.combos.size();
+	if (summary_name != NULL && resume) {
+		fprintf(stderr, "-summary cannot be combined with -resume, which does not analyze the sites before the checkpoint.\n");
 		exit(1);
 	}
+	if (out_stdout && num_combos > 1) {
+		fprintf(stderr, "A sweep over several -min_Nc or -cv values cannot be written to stdout.\n");
+		exit(1);
+	}
+
+	vector <string> out_names = combo_file_names(out_file_name, min_Nc, cv);
+	vector <string> out_compress;	// command compressing each output, empty when it is written directly
+	for (size_t cg = 0; cg < num_combos; cg++) {
+		const string &name = out_names[cg];
+		const char *missing_tool;
+		string compress = compress_command(name.c_str(), num_threads, missing_tool);
+		if (missing_tool != NULL) {
+			fprintf(stderr, "Cannot compress %s: %s is not found in PATH.\n", name.c_str(), missing_tool);
+			exit(1);
+		}
+		out_compress.push_back(compress);
+	}
+
+	// Checkpoints need an input file that can be repositioned and output files that can be truncated
+	if (resume && checkpoint_interval <= 0.0) {
+		checkpoint_interval = 60.0;
+	}
+	string checkpoint_name = checkpoint_file_name(out_file_name);
+	string settings;	// settings that must not change between a run and its resumption
+	CheckpointState resume_state;
+	bool resumed = false;
+	if (checkpoint_interval > 0.0) {
+		bool can_checkpoint = inputFile.is_regular() && strcmp(in_file_name, "-") != 0 && !out_stdout;
+		for (size_t cg = 0; cg < num_combos; cg++) {
+			can_checkpoint = can_checkpoint && out_compress[cg].empty();
+		}
+		if (!can_checkpoint) {
+			fprintf(stderr, "-checkpoint and -resume need an uncompressed input file and uncompressed output files.\n");
+			exit(1);
+		}
+		char buf[64];
+		settings = "num_pops=" + to_string(num_pops) + " min_Nc=";
+		for (size_t ig = 0; ig < min_Nc.size(); ig++) {
+			snprintf(buf, sizeof(buf), "%s%.17g", (ig > 0) ? "," : "", min_Nc[ig]);
+			settings += buf;
+		}
+		settings += " cv=";
+		for (size_t ig = 0; ig < cv.size(); ig++) {
+			snprintf(buf, sizeof(buf), "%s%.17g", (ig > 0) ? "," : "", cv[ig]);
+			settings += buf;
+		}
+		settings += " region=" + string( (region != NULL) ? region : "-" ) + " shard=" + to_string(shard) + "/" + to_string(num_shards) + " pops=";
+		for (int k = 0; k < num_analyzed; k++) {
+			settings += ( (k > 0) ? "," : "" ) + to_string(pop_columns.pop_id[k]);
+		}
+	}
+	if (resume) {
+		if ( read_checkpoint(checkpoint_name, inputFile.size(), inputFile.mtime(), settings, out_names, resume_state) ) {
+			if ( resume_state.input_offset < inputFile.offset() || !inputFile.set_range(resume_state.input_offset, inputFile.end_offset()) ) {
+				fprintf(stderr, "The checkpoint %s does not match the input.\n", checkpoint_name.c_str());
+				exit(1);
+			}
+			resumed = true;
+			fprintf(stderr, "Resuming after %s %d\n", resume_state.scaffold.c_str(), resume_state.site);
+		} else {
+			fprintf(stderr, "No checkpoint of this run in %s; starting from the beginning.\n", checkpoint_name.c_str());
+		}
+	}
+
+	// Open the output files, compressing them in a child process when the name ends in .gz, .bgz or .zst.
+	// When resuming, the output files are truncated to their size at the checkpoint.
+	vector <FILE *> outstreams;
+	vector < unique_ptr<OutputWriter> > out_writers;
+	vector <OutputWriter *> writers;
+	for (size_t cg = 0; cg < num_combos; cg++) {
+		const string &name = out_names[cg];
+		const string &compress = out_compress[cg];
+		FILE *outstream;
+		uint64_t out_offset = 0;
+		if (resumed) {
+			out_offset = resume_state.out_offsets[cg];
+			outstream = fopen(name.c_str(), "r+");
+			struct stat st;
+			if ( outstream != NULL && ( fstat(fileno(outstream), &st) != 0 || (uint64_t)st.st_size < out_offset || ftruncate(fileno(outstream), (off_t)out_offset) != 0 || fseeko(outstream, (off_t)out_offset, SEEK_SET) != 0 ) ) {
+				fprintf(stderr, "Cannot truncate %s to its checkpoint.\n", name.c_str());
+				exit(1);
+			}
+		} else {
+			outstream = out_stdout ? stdout : ( !compress.empty() ? popen(compress.c_str(), "w") : fopen(name.c_str(), "w") );
+		}
+		if (outstream == NULL ) { // Exit on failure
+			fprintf(stderr, "Cannot open %s for writing.\n", name.c_str());
+			exit(1);
+		}
+		outstreams.push_back(outstream);
+		out_writers.push_back( unique_ptr<OutputWriter>(new OutputWriter(outstream, out_offset)) );
+		writers.push_back( out_writers.back().get() );
+
+		// Print out the field names
+		if (!resumed) {
+			writers[cg]->write("scaffold\tsite\tref_nuc\ttot_cov\tne_pops\tnum_alleles\tprivate_allele\tid_pop\tfocal_frequency\ttotal_frequency\tlog_prob_pa\tMAF\n");
+		}
+	}
 	
-	// Print out the field names
-	fprintf(outstream, "scaffold\tsite\tref_nuc\ttot_cov\tne_pops\tnum_alleles\tprivate_allele\tid_pop\tfocal_frequency\ttotal_frequency\tlog_prob_pa\tMAF\n");
-	// printf("scaffold\tsite\tref_nuc\ttot_cov\tne_pops\tnum_alleles\tprivate_allele\tid_pop\tfocal_frequency\ttotal_frequency\tlog_prob_pa\tMAF\n");
-	
-	// Read the main data
-	string scaffold, ref_nuc, n1[num_pops+1], n2[num_pops+1], s_Nc[num_pops+1], s_best_p[num_pops+1], s_best_q[num_pops+1], best_error, s_best_H[num_pops+1], s_pol_llstat[num_pops+1];
-	double Nc[num_pops+1], pol_llstat[num_pops+1]; 
-	int site, pop_cov[num_pops+1], num_alleles;
-	int tot_cov;		// total coverage (sum of the coverage across the populations)
-	int ne_pops;            // total number of populations with data
-	double sum_Nc;		// Sum of the effective number of sampled chromosomes over populations with data
-	vector <string> alleles;   // store allele identities
-	int ag;		// allele counter
-	int pg;		// population counter
-	vector <int> id_pop_a;	// id of the population with an allele
-	vector <double> freq_a;		// frequency of the allele in the population
-	int num_pops_a;			// number of populations that have an allele
-	double sum_freq_a;		// sum of the frequencies of the allele over populations with data
-	double mean_freq_a;           // mean of the frequencies of the allele over populations with data
-	double maf_total;		// minor allele frequency in the total population
-	double Nc_focal;		// effective number of sampled chromosomes in the focal population
-	double Nc_other;		// effective number of sampled chromosomes in the other populations
-	vector <string> private_allele;	// private allele
-	vector <int> id_pop_pa;		// id of the population with the private allele
-	vector <double> focal_paf;	// private-allele frequency in the focal population
-	vector <double> total_paf;	// private-allele frequency in the total population
-	double t_prob_pa;		// temporarily stores the probability of the private allele
-	vector <double> log_prob_pa;	// logarithm of the probability of the private allele
-	int num_pa;			// number of private alleles
-
-	while ( getline(inputFile, line) ) {
-		istringstream ss(line);
-		alleles.clear();
-		tot_cov = 0;
-		ne_pops = 0;
-		sum_Nc = 0.0;
-		ss >> scaffold >> site >> ref_nuc;
-		for (pg = 1; pg <= num_pops; pg++) {
-			ss >> n1[pg] >> n2[pg] >> pop_cov[pg] >> s_Nc[pg] >> s_best_p[pg] >> s_best_q[pg] >> best_error >> s_best_H[pg] >> s_pol_llstat[pg];
-			tot_cov = tot_cov + pop_cov[pg];
-			// printf("site: %d\tpop: %d\tn1: %s\tn2: %s\n", site, pg, n1[pg].c_str(), n2[pg].c_str());
-			// fprintf(outstream, "site: %d\tpop: %d\tn1: %s\tn2: %s\n", site, pg, n1[pg].c_str(), n2[pg].c_str());
-			if (n1[pg] != "NA") {
-				Nc[pg] = atof(s_Nc[pg].c_str());
-				if (Nc[pg] >= min_Nc) {
-					ne_pops = ne_pops + 1;
-					sum_Nc = sum_Nc + Nc[pg];
-                                	if ( find(alleles.begin(), alleles.end(), n1[pg]) == alleles.end() ) {
-						// printf("%s\n", n1[pg].c_str());
-                                        	alleles.push_back(n1[pg]);
-                                	}
-                        		if (n2[pg] != "NA") {
-						pol_llstat[pg] = atof(s_pol_llstat[pg].c_str());
-						if (pol_llstat[pg] > cv) {
-                                			if ( find(alleles.begin(), alleles.end(), n2[pg]) == alleles.end() ) {
-								// printf("%s\n", n2[pg].c_str());
-                                        			alleles.push_back(n2[pg]);
-							}
-                                		}
-					}
-				}
-                        }
-		}
-		// Count the number of alleles segregating in the population sample
-		num_alleles = alleles.size();
-		/*
-		printf("site: %d\tnum_alleles: %d\n", site, num_alleles);
-		fprintf(outstream, "site: %d\tnum_alleles: %d\n", site, num_alleles);
-		for (ag=0; ag<num_alleles; ag++) {
-			printf("%s\n", alleles.at(ag).c_str());
-		}
-		*/
-		// clear the vectors for private alleles
-		private_allele.clear();
-		id_pop_pa.clear();
-		focal_paf.clear();
-		total_paf.clear();
-		log_prob_pa.clear();
-		for (ag = 0; ag < num_alleles; ag++) {		// Examine each of the alleles
-			sum_freq_a = 0.0;
-			// Clear the vectors on alleles
-			id_pop_a.clear();
-			freq_a.clear();
-			for (pg = 1; pg <= num_pops; pg++) { // Examine the allele over the populations
-				if (n1[pg] != "NA" && Nc[pg] >= min_Nc) {	// Examine the population only when there are ML estimates with Nc equal to or greater than the specified value at the site
-					if ( n1[pg] == alleles.at(ag) ) {
-						id_pop_a.push_back(pg);
-						freq_a.push_back( atof(s_best_p[pg].c_str()) );
-						sum_freq_a = sum_freq_a + atof(s_best_p[pg].c_str());
-					} else if ( n2[pg] == alleles.at(ag) ) {
-						id_pop_a.push_back(pg);
-						freq_a.push_back( atof(s_best_q[pg].c_str()) );
-						sum_freq_a = sum_freq_a + atof(s_best_q[pg].c_str());
-					}
-				}
+	// Read and analyze the main data
+	RunStats stats;
+	Progress progress;
+	unique_ptr <ProgressMonitor> monitor;
+	if (progress_file_name != NULL && progress_interval <= 0.0) {
+		progress_interval = 10.0;
+	}
+	if (progress_interval > 0.0) {
+		uint64_t total_bytes = inputFile.is_regular() ? inputFile.end_offset() - inputFile.offset() : 0;
+		monitor.reset( new ProgressMonitor(progress, progress_interval, progress_file_name, total_bytes) );
+	}
+	unique_ptr <Checkpointer> checkpointer;
+	if (checkpoint_interval > 0.0) {
+		checkpointer.reset( new Checkpointer(checkpoint_name, checkpoint_interval, inputFile.size(), inputFile.mtime(), settings, out_names) );
+	}
+	vector < vector <int> > numa_nodes;
+	if (use_numa != 0 && num_threads > 1) {
+		numa_nodes = numa_node_cpus();
+		if (numa_nodes.size() > 1) {
+			fprintf(stderr, "Spreading %d threads over %zu NUMA nodes\n", num_threads, numa_nodes.size());
+		} else {
+			fprintf(stderr, "Note: only one NUMA node found, -numa has no effect\n");
+			numa_nodes.clear();
+		}
+	}
+	process_input(inputFile, sweep, writers, num_threads, stats, monitor ? &progress : NULL, checkpointer.get(), &numa_nodes);
+	if (monitor) {
+		monitor->stop();
+	}
+	if ( !inputFile.close() ) {
+		fprintf(stderr, "Error reading %s.\n", in_file_name);
+		exit(1);
+	}
+	for (size_t cg = 0; cg < num_combos; cg++) {
+		bool write_ok = writers[cg]->flush() && !ferror(outstreams[cg]);
+		if ( (!out_compress[cg].empty() ? pclose(outstreams[cg]) : fclose(outstreams[cg])) != 0 || !write_ok ) {
+			fprintf(stderr, "Error writing to %s.\n", out_names[cg].c_str());
+			exit(1);
+		}
+	}
+	if (checkpointer) {	// the run is complete
+		unlink( checkpoint_name.c_str() );
+	}
+	if (summary_name != NULL) {
+		ThreadStats total = total_stats(stats, num_combos);
+		vector <string> summary_names = combo_file_names(summary_name, min_Nc, cv);
+		for (size_t cg = 0; cg < num_combos; cg++) {
+			const string &name = summary_names[cg];
+			if ( !write_summary(name, total.summaries[cg], pop_columns) ) {
+				fprintf(stderr, "Error writing to %s.\n", name.c_str());
+				exit(1);
 			}
-			num_pops_a = id_pop_a.size();
-			mean_freq_a = sum_freq_a/ne_pops;
-			if (ag == 0) {
-				maf_total = mean_freq_a;
-			} else {
-				if (mean_freq_a < maf_total) {
-					maf_total = mean_freq_a;
-				}
-			}
-			if (ne_pops >= 2 && num_pops_a == 1) {		// private allele
-				private_allele.push_back(alleles.at(ag).c_str());
-				id_pop_pa.push_back(id_pop_a.at(0));
-				focal_paf.push_back(freq_a.at(0));	
-				total_paf.push_back(mean_freq_a);
-				Nc_focal = Nc[id_pop_a.at(0)];
-				Nc_other = sum_Nc - Nc_focal;
-				t_prob_pa = ( 1.0-pow(1.0-mean_freq_a,Nc_focal) )*pow(1.0-mean_freq_a,Nc_other);
-				log_prob_pa.push_back( log10(t_prob_pa) );
-			}
-		}
-		// print out the results
-		num_pa = private_allele.size();
-		if (num_pa >= 1) {
-			for (ag = 0; ag < num_pa; ag++) {
-				fprintf(outstream, "%s\t%d\t%s\t%d\t%d\t%d\t%s\t%d\t%f\t%f\t%f\t%f\n", scaffold.c_str(), site, ref_nuc.c_str(), tot_cov, ne_pops, num_alleles, private_allele.at(ag).c_str(), id_pop_pa.at(ag), focal_paf.at(ag), total_paf.at(ag), log_prob_pa.at(ag), maf_total);
-				// printf("%s\t%d\t%s\t%d\t%d\t%d\t%s\t%d\t%f\t%f\t%f\t%f\n", scaffold.c_str(), site, ref_nuc.c_str(), tot_cov, ne_pops, num_alleles, private_allele.at(ag).c_str(), id_pop_pa.at(ag), focal_paf.at(ag), total_paf.at(ag), log_prob_pa.at(ag), maf_total);
-			}
-		}   						
-	} 		
+		}
+	}
+	if (print_stats_report) {
+		print_stats(stderr, stats, sweep);
+	}
+	if ( stats_json_name != NULL && !write_stats_json(stats_json_name, stats, sweep) ) {
+		fprintf(stderr, "Error writing to %s.\n", stats_json_name);
+		exit(1);
+	}
 
 	return 0;
 }
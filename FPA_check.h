@@ -0,0 +1,512 @@
+// FPA_check.h: -bench and -selftest of FPA_check, the build of FPA.cpp with -DFPA_CHECK made by make check.
+//
+// The reference implementation of the original algorithm, the edge cases and the throughput checks are kept
+// out of the FPA binary.  This file is included by FPA.cpp after the pipeline, whose functions it uses.
+
+#ifndef FPA_CHECK_H
+#define FPA_CHECK_H
+
+// The per-site analysis as implemented by the original FPA.cpp (an istringstream per line, alleles as
+// strings, and the probability computed with pow and log10), kept as the reference for -bench and -selftest
+static void reference_analyze(const string &text, int num_pops, double min_Nc, double cv, string &out)
+{
+	istringstream input(text);
+	string line;
+	string scaffold, ref_nuc, best_error, s_best_H;
+	vector <string> n1(num_pops+1), n2(num_pops+1), s_Nc(num_pops+1), s_best_p(num_pops+1), s_best_q(num_pops+1), s_pol_llstat(num_pops+1);
+	vector <double> Nc(num_pops+1), pol_llstat(num_pops+1);
+	vector <int> pop_cov(num_pops+1);
+	vector <string> alleles, private_allele;
+	vector <int> id_pop_a, id_pop_pa;
+	vector <double> freq_a, focal_paf, total_paf, log_prob_pa;
+	int site, tot_cov, ne_pops, num_alleles, pg, ag, num_pops_a;
+	double sum_Nc, sum_freq_a, mean_freq_a, maf_total = 0.0, Nc_focal, Nc_other, t_prob_pa;
+	getline(input, line);	// header
+	while ( getline(input, line) ) {
+		istringstream ss(line);
+		alleles.clear();
+		tot_cov = 0;
+		ne_pops = 0;
+		sum_Nc = 0.0;
+		ss >> scaffold >> site >> ref_nuc;
+		for (pg = 1; pg <= num_pops; pg++) {
+			ss >> n1[pg] >> n2[pg] >> pop_cov[pg] >> s_Nc[pg] >> s_best_p[pg] >> s_best_q[pg] >> best_error >> s_best_H >> s_pol_llstat[pg];
+			tot_cov = tot_cov + pop_cov[pg];
+			if (n1[pg] != "NA") {
+				Nc[pg] = atof(s_Nc[pg].c_str());
+				if (Nc[pg] >= min_Nc) {
+					ne_pops = ne_pops + 1;
+					sum_Nc = sum_Nc + Nc[pg];
+					if ( find(alleles.begin(), alleles.end(), n1[pg]) == alleles.end() ) {
+						alleles.push_back(n1[pg]);
+					}
+					if (n2[pg] != "NA") {
+						pol_llstat[pg] = atof(s_pol_llstat[pg].c_str());
+						if (pol_llstat[pg] > cv) {
+							if ( find(alleles.begin(), alleles.end(), n2[pg]) == alleles.end() ) {
+								alleles.push_back(n2[pg]);
+							}
+						}
+					}
+				}
+			}
+		}
+		num_alleles = alleles.size();
+		private_allele.clear();
+		id_pop_pa.clear();
+		focal_paf.clear();
+		total_paf.clear();
+		log_prob_pa.clear();
+		for (ag = 0; ag < num_alleles; ag++) {
+			sum_freq_a = 0.0;
+			id_pop_a.clear();
+			freq_a.clear();
+			for (pg = 1; pg <= num_pops; pg++) {
+				if (n1[pg] != "NA" && Nc[pg] >= min_Nc) {
+					if ( n1[pg] == alleles.at(ag) ) {
+						id_pop_a.push_back(pg);
+						freq_a.push_back( atof(s_best_p[pg].c_str()) );
+						sum_freq_a = sum_freq_a + atof(s_best_p[pg].c_str());
+					} else if ( n2[pg] == alleles.at(ag) ) {
+						id_pop_a.push_back(pg);
+						freq_a.push_back( atof(s_best_q[pg].c_str()) );
+						sum_freq_a = sum_freq_a + atof(s_best_q[pg].c_str());
+					}
+				}
+			}
+			num_pops_a = id_pop_a.size();
+			mean_freq_a = sum_freq_a/ne_pops;
+			if (ag == 0) {
+				maf_total = mean_freq_a;
+			} else {
+				if (mean_freq_a < maf_total) {
+					maf_total = mean_freq_a;
+				}
+			}
+			if (ne_pops >= 2 && num_pops_a == 1) {
+				private_allele.push_back(alleles.at(ag));
+				id_pop_pa.push_back(id_pop_a.at(0));
+				focal_paf.push_back(freq_a.at(0));
+				total_paf.push_back(mean_freq_a);
+				Nc_focal = Nc[id_pop_a.at(0)];
+				Nc_other = sum_Nc - Nc_focal;
+				t_prob_pa = ( 1.0-pow(1.0-mean_freq_a,Nc_focal) )*pow(1.0-mean_freq_a,Nc_other);
+				log_prob_pa.push_back( log10(t_prob_pa) );
+			}
+		}
+		for (ag = 0; ag < (int)private_allele.size(); ag++) {
+			char buf[1024];
+			snprintf(buf, sizeof(buf), "%s\t%d\t%s\t%d\t%d\t%d\t%s\t%d\t%f\t%f\t%f\t%f\n", scaffold.c_str(), site, ref_nuc.c_str(), tot_cov, ne_pops, num_alleles, private_allele.at(ag).c_str(), id_pop_pa.at(ag), focal_paf.at(ag), total_paf.at(ag), log_prob_pa.at(ag), maf_total);
+			out += buf;
+		}
+	}
+}
+
+// Compare the output of the engine with that of the reference implementation and return the number of
+// records that differ.  Records must be identical, except that log_prob_pa may differ where the reference
+// loses precision in subnormal numbers or underflows to -inf (see log_prob_kernel).
+static long compare_outputs(const string &engine, const string &reference)
+{
+	istringstream es(engine), rs(reference);
+	string e_line, r_line;
+	long num_diff = 0;
+	while (true) {
+		bool e_more = (bool)getline(es, e_line);
+		bool r_more = (bool)getline(rs, r_line);
+		if (!e_more || !r_more) {
+			if (e_more || r_more) {
+				num_diff++;	// a record in only one of the outputs
+				continue;
+			}
+			break;
+		}
+		if (e_line == r_line) {
+			continue;
+		}
+		vector <string_view> e_fields, r_fields;
+		split_fields(e_line, e_fields, 12);
+		split_fields(r_line, r_fields, 12);
+		bool same = true;
+		for (int fg = 0; fg < 12; fg++) {
+			if (fg != 10 && e_fields[fg] != r_fields[fg]) {
+				same = false;
+			}
+		}
+		double e_log_prob = parse_double(e_fields[10]);
+		double r_log_prob = (r_fields[10] == "-inf") ? -HUGE_VAL : parse_double(r_fields[10]);
+		if ( !(r_log_prob < -307.0 && e_log_prob < -300.0) && fabs(e_log_prob - r_log_prob) > 1.5e-6 ) {
+			same = false;
+		}
+		if (!same) {
+			num_diff++;
+		}
+	}
+	return num_diff;
+}
+
+static double elapsed_seconds(const chrono::steady_clock::time_point &start)
+{
+	return chrono::duration <double> (chrono::steady_clock::now() - start).count();
+}
+
+static void print_stage(const char *stage, double seconds, long num_sites, size_t num_bytes)
+{
+	printf("%-12s\t%10.4f\t%12.0f\t%10.1f\n", stage, seconds, num_sites/seconds, num_bytes/seconds/1e6);
+}
+
+// Run the whole pipeline of the program on text, read from a temporary file as text or converted to the
+// binary columnar format, and put the records written in out.  seconds is the wall time of process_input.
+// Returns false when a temporary file cannot be used.
+static bool run_pipeline(const string &text, const FPASweep &sweep, int num_threads, bool binary, string &out, double &seconds)
+{
+	char text_name[] = "/tmp/FPA_check_XXXXXX", bin_name[] = "/tmp/FPA_check_XXXXXX";
+	int text_fd = mkstemp(text_name);
+	if (text_fd < 0) {
+		return false;
+	}
+	bool ok = ( write(text_fd, text.data(), text.size()) == (ssize_t)text.size() );
+	::close(text_fd);
+	const char *in_name = text_name;
+	int bin_fd = -1;
+	if (ok && binary) {
+		bin_fd = mkstemp(bin_name);
+		InputReader textInput;
+		string_view header;
+		ok = bin_fd >= 0 && textInput.open(text_name, true) && textInput.next_line(header) && convert_input(textInput, header, sweep.parse, bin_name);
+		ok = textInput.close() && ok;
+		in_name = bin_name;
+	}
+	InputReader input;
+	string_view header;
+	FILE *outstream = tmpfile();
+	if ( ok && outstream != NULL && input.open(in_name, true) ) {
+		input.next_line(header);
+		OutputWriter writer(outstream);
+		vector <OutputWriter *> writers(1, &writer);
+		RunStats stats;
+		process_input(input, sweep, writers, num_threads, stats);
+		seconds = stats.wall_seconds;
+		ok = writer.flush() && input.close() && fseeko(outstream, 0, SEEK_SET) == 0;
+		out.clear();
+		char buffer[65536];
+		size_t n;
+		while ( ok && (n = fread(buffer, 1, sizeof(buffer), outstream)) > 0 ) {
+			out.append(buffer, n);
+		}
+	} else {
+		ok = false;
+	}
+	if (outstream != NULL) {
+		fclose(outstream);
+	}
+	unlink(text_name);
+	if (bin_fd >= 0) {
+		::close(bin_fd);
+		unlink(bin_name);
+	}
+	return ok;
+}
+
+// Benchmark the stages of the analysis on synthetic input and validate the output against the reference
+// implementation.  Returns the exit status: 0 when the outputs agree.
+static int run_benchmark(const SynthParams &sp, const FPAConfig &t_config, int num_threads)
+{
+	FPAConfig config = t_config;
+	config.num_pops = sp.num_pops;
+	config.columns = gfe_column_map(sp.num_pops);
+	config.reject_sites = true;
+	config.use_region = false;
+	FPASweep sweep;
+	sweep.parse = config;
+	sweep.combos.push_back(config);
+
+	printf("Synthetic input: %d populations, %ld sites, NA rate %g, polymorphism rate %g, Nc %g-%g\n", sp.num_pops, sp.num_sites, sp.na_rate, sp.poly_rate, sp.min_Nc, sp.max_Nc);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	string text;
+	generate_synthetic(sp, text);
+	printf("Generated %.1f MB in %.3f s\n\n", text.size()/1e6, elapsed_seconds(start));
+	size_t body = text.find('\n') + 1;
+	string_view lines(text.data() + body, text.size() - body);
+	printf("%-12s\t%10s\t%12s\t%10s\n", "stage", "seconds", "sites/s", "MB/s");
+
+	// Parse
+	start = chrono::steady_clock::now();
+	vector <SiteBatch> batches;
+	vector <string_view> fields;
+	size_t pos = 0;
+	while (pos < lines.size()) {
+		const char *nl = (const char *)memchr(lines.data() + pos, '\n', lines.size() - pos);
+		size_t len = (nl != NULL) ? (size_t)(nl - lines.data() - pos) : lines.size() - pos;
+		if ( batches.empty() || batches.back().full() ) {
+			batches.push_back( SiteBatch() );
+			batches.back().init(config.num_pops, SITE_BATCH_SIZE);
+		}
+		parse_site(lines.substr(pos, len), config, fields, batches.back());
+		pos = pos + len + 1;
+	}
+	print_stage("parse", elapsed_seconds(start), sp.num_sites, lines.size());
+
+	// Per-site computation
+	SiteScratch sc(config.num_pops);
+	vector < vector <PrivateAlleleRecord> > records( batches.size() );
+	AnalysisCounters counts = {};
+	start = chrono::steady_clock::now();
+	for (size_t bg = 0; bg < batches.size(); bg++) {
+		compute_batch(batches[bg], config, sc, counts);
+		records[bg] = sc.records;
+	}
+	print_stage("compute", elapsed_seconds(start), sp.num_sites, lines.size());
+
+	// Output formatting
+	string engine_out;
+	start = chrono::steady_clock::now();
+	for (size_t bg = 0; bg < batches.size(); bg++) {
+		format_records(batches[bg], records[bg], engine_out);
+	}
+	print_stage("output", elapsed_seconds(start), sp.num_sites, engine_out.size());
+
+	// The whole pipeline on a temporary file, with the requested number of threads
+	string pipeline_out;
+	double seconds;
+	if ( !run_pipeline(text, sweep, num_threads, false, pipeline_out, seconds) ) {
+		fprintf(stderr, "Cannot use a temporary file in /tmp.\n");
+		return 1;
+	}
+	char stage[32];
+	snprintf(stage, sizeof(stage), "total(%dt)", (num_threads > 1) ? num_threads : 1);
+	print_stage(stage, seconds, sp.num_sites, text.size());
+
+	// Reference implementation and validation
+	string reference_out;
+	start = chrono::steady_clock::now();
+	reference_analyze(text, config.num_pops, config.min_Nc, config.cv, reference_out);
+	print_stage("reference", elapsed_seconds(start), sp.num_sites, text.size());
+	long num_diff = compare_outputs(engine_out, reference_out) + (pipeline_out != engine_out);
+	size_t num_records = count(engine_out.begin(), engine_out.end(), '\n');
+	if (num_diff == 0) {
+		printf("\nValidation passed: %zu private-allele records identical to the reference implementation and the whole pipeline\n", num_records);
+		return 0;
+	}
+	printf("\nValidation FAILED: %ld of %zu records differ from the reference implementation%s\n", num_diff, num_records, (pipeline_out != engine_out) ? ", or the whole pipeline differs" : "");
+	return 1;
+}
+
+// Columns of a population in the combined GFE p-mode layout.  A population without data has NA in every
+// field but the coverage.
+static string gfe_pop_columns(const char *n1, const char *n2, double Nc, double p, const char *pol_llstat)
+{
+	char buf[256];
+	if (strcmp(n1, "NA") == 0) {
+		snprintf(buf, sizeof(buf), "\tNA\tNA\t5\tNA\tNA\tNA\tNA\tNA\tNA");
+	} else {
+		snprintf(buf, sizeof(buf), "\t%s\t%s\t%d\t%f\t%f\t%f\t0.001000\t%f\t%s", n1, n2, (int)(1.5*Nc), Nc, p, 1.0 - p, 2.0*p*(1.0 - p), pol_llstat);
+	}
+	return string(buf);
+}
+
+// Throughput of one configuration of the pipeline in a baseline file of the self-test.  Absolute throughputs
+// depend on the machine, so the baseline file is local to it: the first passing run writes it, and it is
+// not in the repository.
+struct BaselineRate {
+	string input;		// text or binary
+	int threads;
+	double sites_per_second;
+};
+
+const double BASELINE_TOLERANCE = 0.4;	// fraction of the baseline throughput that a run may fall below it
+const int THROUGHPUT_RUNS = 5;		// runs of each configuration, of which the fastest counts
+
+// Read a baseline file: a comment line, then the input, the number of threads and the sites/s of each
+// configuration, tab-separated.  Returns false when the file cannot be read.
+static bool read_baseline(const char *file_name, vector <BaselineRate> &rates)
+{
+	ifstream baselineFile(file_name);
+	string line;
+	if ( !baselineFile.is_open() ) {
+		return false;
+	}
+	rates.clear();
+	while ( getline(baselineFile, line) ) {
+		if ( line.empty() || line[0] == '#' ) {
+			continue;
+		}
+		istringstream ls(line);
+		BaselineRate rate;
+		if ( !(ls >> rate.input >> rate.threads >> rate.sites_per_second) ) {
+			return false;
+		}
+		rates.push_back(rate);
+	}
+	return true;
+}
+
+static bool write_baseline_file(const char *file_name, const vector <BaselineRate> &rates)
+{
+	FILE *baselinestream = fopen(file_name, "w");
+	if (baselinestream == NULL) {
+		return false;
+	}
+	fprintf(baselinestream, "# Throughput of the pipeline in FPA_check -selftest on this machine: input, threads, sites/s\n");
+	for (size_t rg = 0; rg < rates.size(); rg++) {
+		fprintf(baselinestream, "%s\t%d\t%.0f\n", rates[rg].input.c_str(), rates[rg].threads, rates[rg].sites_per_second);
+	}
+	return fclose(baselinestream) == 0;
+}
+
+// Self-test of the program: the edge cases of the per-site analysis and a synthetic input, checked
+// against the reference implementation and across the text and binary inputs and the thread counts,
+// then the throughput of the pipeline on a larger synthetic input, the best of THROUGHPUT_RUNS runs.  With
+// write_baseline the throughputs of a passing self-test are written to the file baseline_name.  Otherwise a
+// throughput more than BASELINE_TOLERANCE below its baseline in baseline_name fails; a configuration not
+// in the file, or every one when there is no file yet, is reported and added to it when the test passes.
+// Returns the exit status: 0 when every check passes.
+static int run_selftest(int num_threads, const char *baseline_name, bool write_baseline)
+{
+	const double min_Nc = 20.0, cv = 5.991;
+	int num_failed = 0;
+	vector <BaselineRate> baseline, rates;
+	bool add_to_baseline = false;	// whether the baseline file is written with the new configurations
+	if ( baseline_name != NULL && !write_baseline && access(baseline_name, F_OK) == 0 && !read_baseline(baseline_name, baseline) ) {
+		fprintf(stderr, "Cannot read the baseline %s; make baseline writes it again.\n", baseline_name);
+		return 1;
+	}
+
+	// Edge cases, three populations per site; each case also has sites that just pass
+	struct EdgeCase {
+		const char *name;
+		vector < vector <string> > sites;	// for each site, n1, n2, Nc, p and pol_llstat of each population
+	};
+	const vector <EdgeCase> cases = {
+		{"all-NA populations", {
+			{"NA", "NA", "0", "0", "NA",	"NA", "NA", "0", "0", "NA",	"NA", "NA", "0", "0", "NA"},
+			{"NA", "NA", "0", "0", "NA",	"A", "NA", "30", "1", "NA",	"NA", "NA", "0", "0", "NA"},
+			{"NA", "NA", "0", "0", "NA",	"A", "NA", "30", "1", "NA",	"C", "NA", "30", "1", "NA"}}},
+		{"n2 == NA", {
+			{"A", "NA", "30", "1", "NA",	"A", "NA", "40", "1", "NA",	"C", "NA", "25", "1", "NA"},
+			{"A", "NA", "30", "1", "NA",	"G", "NA", "40", "1", "NA",	"C", "NA", "25", "1", "NA"},
+			{"T", "NA", "30", "1", "NA",	"T", "NA", "40", "1", "NA",	"T", "NA", "25", "1", "NA"}}},
+		{"Nc == min_Nc", {
+			{"A", "NA", "30", "1", "NA",	"A", "NA", "40", "1", "NA",	"C", "NA", "20", "1", "NA"},
+			{"A", "NA", "30", "1", "NA",	"A", "NA", "40", "1", "NA",	"C", "NA", "19.999999", "1", "NA"},
+			{"A", "G", "20", "0.7", "40",	"A", "NA", "20", "1", "NA",	"NA", "NA", "0", "0", "NA"}}},
+		{"pol_llstat == cv", {
+			{"A", "G", "30", "0.8", "5.991",	"A", "NA", "40", "1", "NA",	"A", "NA", "25", "1", "NA"},
+			{"A", "G", "30", "0.8", "5.991001",	"A", "NA", "40", "1", "NA",	"A", "NA", "25", "1", "NA"},
+			{"A", "G", "30", "0.8", "5.990999",	"A", "G", "40", "0.9", "6",	"A", "NA", "25", "1", "NA"}}},
+		{"single-population sites", {
+			{"A", "G", "30", "0.6", "50",	"NA", "NA", "0", "0", "NA",	"NA", "NA", "0", "0", "NA"},
+			{"A", "G", "30", "0.6", "50",	"C", "NA", "10", "1", "NA",	"T", "NA", "19", "1", "NA"},
+			{"N", "NA", "30", "1", "NA",	"A", "A", "40", "1", "30",	"NA", "NA", "0", "0", "NA"}}},
+		{"underflow of prob_pa", {
+			{"A", "G", "5000", "0.5", "900",	"A", "NA", "6000", "1", "NA",	"A", "NA", "7000", "1", "NA"},
+			{"C", "T", "30", "0.999", "8",	"C", "NA", "40", "1", "NA",	"C", "NA", "25", "1", "NA"}}},
+	};
+	FPAConfig config = {};
+	config.num_pops = 3;
+	config.columns = gfe_column_map(3);
+	config.min_Nc = min_Nc;
+	config.cv = cv;
+	config.reject_sites = true;
+	FPASweep sweep;
+	sweep.parse = config;
+	sweep.combos.push_back(config);
+	string header = "scaffold\tsite\tref_nuc";
+	for (int pg = 1; pg <= 3; pg++) {
+		header += "\tmajor_allele\tminor_allele\tpop_coverage\tNc\tbest_p\tbest_q\tbest_error\tbest_H\tpol_llstat";
+	}
+	header += "\n";
+	printf("Edge cases, min_Nc %g, cv %g\n", min_Nc, cv);
+	for (size_t eg = 0; eg < cases.size(); eg++) {
+		string text = header;
+		for (size_t sg = 0; sg < cases[eg].sites.size(); sg++) {
+			const vector <string> &site = cases[eg].sites[sg];
+			text += "edge_" + to_string(eg + 1) + "\t" + to_string(sg + 1) + "\tA";
+			for (int pg = 0; pg < 3; pg++) {
+				text += gfe_pop_columns(site[5*pg].c_str(), site[5*pg + 1].c_str(), atof(site[5*pg + 2].c_str()), atof(site[5*pg + 3].c_str()), site[5*pg + 4].c_str());
+			}
+			text += "\n";
+		}
+		string reference_out, text_out, binary_out, threaded_out;
+		double seconds;
+		reference_analyze(text, 3, min_Nc, cv, reference_out);
+		bool ok = run_pipeline(text, sweep, 1, false, text_out, seconds) && run_pipeline(text, sweep, 1, true, binary_out, seconds) && run_pipeline(text, sweep, 2, false, threaded_out, seconds);
+		ok = ok && compare_outputs(text_out, reference_out) == 0 && binary_out == text_out && threaded_out == text_out;
+		printf("	%-26s %s (%zu records)\n", cases[eg].name, ok ? "passed" : "FAILED", (size_t)count(reference_out.begin(), reference_out.end(), '\n'));
+		num_failed += ok ? 0 : 1;
+	}
+
+	// Synthetic input: the engine against the reference, and the text, binary and threaded runs of the pipeline
+	const int check_threads = max(num_threads, 4);
+	SynthParams sp = {20, 50000, 0.1, 0.2, 10.0, 60.0, 7};
+	config.num_pops = sp.num_pops;
+	config.columns = gfe_column_map(sp.num_pops);
+	sweep.parse = config;
+	sweep.combos.assign(1, config);
+	string text, reference_out, text_out, binary_out, threaded_out;
+	double seconds;
+	generate_synthetic(sp, text);
+	reference_analyze(text, sp.num_pops, min_Nc, cv, reference_out);
+	printf("Synthetic input, %d populations, %ld sites\n", sp.num_pops, sp.num_sites);
+	bool ran = run_pipeline(text, sweep, 1, false, text_out, seconds) && run_pipeline(text, sweep, 1, true, binary_out, seconds) && run_pipeline(text, sweep, check_threads, false, threaded_out, seconds);
+	long num_diff = ran ? compare_outputs(text_out, reference_out) : -1;
+	printf("	%-26s %s (%ld of %zu records differ)\n", "reference implementation", (num_diff == 0) ? "passed" : "FAILED", num_diff, (size_t)count(reference_out.begin(), reference_out.end(), '\n'));
+	printf("	%-26s %s\n", "binary input", (ran && binary_out == text_out) ? "passed" : "FAILED");
+	printf("	%-26s %s\n", (to_string(check_threads) + " threads").c_str(), (ran && threaded_out == text_out) ? "passed" : "FAILED");
+	num_failed += (num_diff == 0 ? 0 : 1) + (ran && binary_out == text_out ? 0 : 1) + (ran && threaded_out == text_out ? 0 : 1);
+
+	// Throughput of the pipeline, serial and with the requested threads
+	sp = {10, 300000, 0.1, 0.1, 10.0, 60.0, 1};
+	config.num_pops = sp.num_pops;
+	config.columns = gfe_column_map(sp.num_pops);
+	sweep.parse = config;
+	sweep.combos.assign(1, config);
+	generate_synthetic(sp, text);
+	printf("Throughput, %d populations, %ld sites (%.1f MB)\n", sp.num_pops, sp.num_sites, text.size()/1e6);
+	vector <int> thread_counts(1, 1);
+	if (num_threads > 1) {
+		thread_counts.push_back(num_threads);
+	}
+	for (size_t tg = 0; tg < thread_counts.size(); tg++) {
+		for (int bg = 0; bg < 2; bg++) {
+			BaselineRate rate = {(bg == 1) ? "binary" : "text", thread_counts[tg], 0.0};
+			bool ok = true;
+			for (int rg = 0; rg < THROUGHPUT_RUNS && ok; rg++) {
+				ok = run_pipeline(text, sweep, thread_counts[tg], bg == 1, text_out, seconds) && seconds > 0.0;
+				rate.sites_per_second = ok ? max(rate.sites_per_second, sp.num_sites/seconds) : 0.0;
+			}
+			const BaselineRate *base = NULL;
+			for (size_t rg = 0; rg < baseline.size(); rg++) {
+				if (baseline[rg].input == rate.input && baseline[rg].threads == rate.threads) {
+					base = &baseline[rg];
+				}
+			}
+			bool fast_enough = ok && (base == NULL || rate.sites_per_second >= (1.0 - BASELINE_TOLERANCE)*base->sites_per_second);
+			printf("	%-6s input, %2d thread%s  %12.0f sites/s  %8.1f MB/s", rate.input.c_str(), rate.threads, (rate.threads > 1) ? "s" : " ", rate.sites_per_second, text.size()*rate.sites_per_second/sp.num_sites/1e6);
+			if (base != NULL) {
+				printf("  (baseline %.0f, %+.0f%%)", base->sites_per_second, 100.0*(rate.sites_per_second/base->sites_per_second - 1.0));
+			} else if (baseline_name != NULL && !write_baseline) {
+				printf("  (not in the baseline)");
+				baseline.push_back(rate);
+				add_to_baseline = true;
+			}
+			printf("%s\n", fast_enough ? "" : "  FAILED");
+			num_failed += fast_enough ? 0 : 1;
+			rates.push_back(rate);
+		}
+	}
+	if ( (write_baseline || add_to_baseline) && num_failed == 0 ) {
+		if ( !write_baseline_file(baseline_name, write_baseline ? rates : baseline) ) {
+			fprintf(stderr, "Error writing to %s.\n", baseline_name);
+			return 1;
+		}
+		printf("\nBaseline written to %s\n", baseline_name);
+	}
+	if (num_failed == 0) {
+		printf("\nSelf-test passed\n");
+		return 0;
+	}
+	printf("\nSelf-test FAILED: %d checks\n", num_failed);
+	return 1;
+}
+
+#endif // FPA_CHECK_H
@@ -0,0 +1,530 @@
+// FPA_core.h: the per-site analysis of FPA.cpp, usable without the command-line program.
+//
+// A program that already holds GFE estimates in memory fills SiteRecords and calls process_batch, which
+// returns the private alleles found; the text input and output of FPA.cpp are not involved.  The program
+// FPA.cpp parses its input into SiteBatches and calls compute_batch directly, so both give the same results.
+// The header needs no library beyond the C++17 standard library, e.g. g++ -std=c++17 -O2 pipeline.cpp.
+
+#ifndef FPA_CORE_H
+#define FPA_CORE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+// Vector math for the loops of log_q_kernel and log_prob_kernel.  Built with -DFPA_LIBMVEC -fopenmp-simd
+// -fno-math-errno -fno-trapping-math and -mavx2 or later (e.g. -march=native, as make FPA_LIBMVEC=1 does)
+// on x86-64 with glibc 2.35 or later, the loops call the vector variants of log1p, expm1, exp and log in
+// libmvec, which libm links in, on 4 (AVX2) or 8 (AVX-512) values at a time: about 1.3 and 2.7 times the
+// speed of libm.  The 2-value SSE variants are slower than libm, so without AVX2 the build keeps calling
+// libm on one value at a time.
+// libmvec is accurate to 4 ulp instead of about 1, so the last printed digit of a log_prob_pa can differ.
+#if defined(FPA_LIBMVEC) && defined(__x86_64__) && defined(__AVX2__) && defined(__GLIBC__) && __GLIBC_PREREQ(2, 35)
+#define FPA_VECTOR_MATH
+extern "C" {
+__attribute__((simd("notinbranch"))) double log1p(double) throw();
+__attribute__((simd("notinbranch"))) double expm1(double) throw();
+__attribute__((simd("notinbranch"))) double exp(double) throw();
+__attribute__((simd("notinbranch"))) double log(double) throw();
+}
+#define FPA_SIMD_LOOP _Pragma("omp simd")
+#else
+#define FPA_SIMD_LOOP
+#endif
+
+// Allele codes used in the per-site analysis.  The nucleotides fit in three bits, so the set of alleles
+// at a site is a bitmask.  Anything other than A, C, G, T or N is treated as missing data, like NA.
+enum { ALLELE_A = 0, ALLELE_C, ALLELE_G, ALLELE_T, ALLELE_N, NUM_ALLELE_CODES, ALLELE_NA = 7 };
+static const char allele_chars[] = "ACGTN";
+
+inline unsigned char allele_code(std::string_view s)
+{
+	if (s.size() == 1) {
+		switch (s[0]) {
+			case 'A': return ALLELE_A;
+			case 'C': return ALLELE_C;
+			case 'G': return ALLELE_G;
+			case 'T': return ALLELE_T;
+			case 'N': return ALLELE_N;
+		}
+	}
+	return ALLELE_NA;
+}
+
+// Population columns used by the analysis.  The estimates of the error rate and the heterozygosity are not used.
+enum PopColumn { COL_N1, COL_N2, COL_COV, COL_NC, COL_P, COL_Q, COL_POL_LLSTAT, NUM_POP_COLUMNS };
+
+// Position of the used fields of a line, found from the header once
+struct ColumnMap {
+	size_t pop_width;		// number of columns of each population
+	size_t offset[NUM_POP_COLUMNS];	// column of each used field among the columns of a population
+	size_t num_fields;		// number of fields of a line up to the last used one
+	int input_pops;			// number of populations in the input
+	std::vector <int> pop_id;		// id in the input (from 1) of each analyzed population, in input order
+};
+
+// Restrict the analysis to the populations of the given ids, which must be in increasing order.  The fields
+// after the last used column of the last of these populations are not split.
+inline void select_populations(ColumnMap &map, const std::vector <int> &ids)
+{
+	map.pop_id = ids;
+	size_t last_used = *std::max_element(map.offset, map.offset + NUM_POP_COLUMNS);
+	map.num_fields = ids.empty() ? 3 : 3 + map.pop_width*(ids.back() - 1) + last_used + 1;
+}
+
+// Column map of the nine columns per population written by GFE: major allele, minor allele, coverage, Nc,
+// p, q, error rate, heterozygosity and pol_llstat
+inline ColumnMap gfe_column_map(int num_pops)
+{
+	ColumnMap map;
+	map.pop_width = 9;
+	const size_t gfe_offset[NUM_POP_COLUMNS] = {0, 1, 2, 3, 4, 5, 8};
+	memcpy(map.offset, gfe_offset, sizeof(gfe_offset));
+	map.input_pops = num_pops;
+	std::vector <int> ids;
+	for (int k = 0; k < num_pops; k++) {
+		ids.push_back(k + 1);
+	}
+	select_populations(map, ids);
+	map.num_fields = 3 + 9*(size_t)num_pops;	// all nine columns, as before
+	return map;
+}
+
+// Settings of the analysis
+struct FPAConfig {
+	int num_pops;		// number of populations in the input
+	ColumnMap columns;	// position of the fields of the populations
+	double min_Nc;		// minimum effective number of sampled chromosomes required in a deme
+	double cv;		// chi-square critical value for the polymorphism test
+	bool reject_sites;	// whether the parser drops sites that cannot have a private allele
+	bool use_region;	// whether only the sites of a region are analyzed
+	std::string_view region_scaffold;	// scaffold of the region
+	int region_start;	// first site of the region
+	int region_end;		// last site of the region
+};
+
+// Batch of parsed sites in structure-of-arrays layout.  The values of population k at site i are stored
+// at i*num_pops + k of each population column, so that the filters and reductions over populations and
+// sites run over contiguous arrays.  Values that the analysis cannot use (e.g. the frequencies of a
+// population with too few sampled chromosomes) are not converted and are stored as zero.
+struct SiteBatch {
+	int num_pops;
+	size_t num_sites;		// number of sites held
+	std::vector <std::string_view> scaffold, ref_nuc;	// per-site fields, pointing into the input
+	std::vector <int> site;
+	std::vector <unsigned char> n1, n2;		// codes of the major and minor alleles
+	std::vector <int> cov;			// population coverage
+	std::vector <double> Nc, p, q, pol_llstat;	// Nc, major- and minor-allele frequencies, polymorphism statistic
+	std::vector <unsigned char> qualified;	// population has ML estimates and Nc >= min_Nc (set by analyze_batch)
+	std::vector <unsigned char> has_minor;	// qualified population with a distinct minor allele (set by analyze_batch)
+	std::vector <unsigned char> significant;	// minor allele passes the polymorphism test (set by analyze_batch)
+
+	void init(int t_num_pops, size_t capacity)
+	{
+		size_t n = capacity*(size_t)t_num_pops;
+		num_pops = t_num_pops;
+		num_sites = 0;
+		scaffold.resize(capacity);
+		ref_nuc.resize(capacity);
+		site.resize(capacity);
+		n1.resize(n);
+		n2.resize(n);
+		cov.resize(n);
+		Nc.resize(n);
+		p.resize(n);
+		q.resize(n);
+		pol_llstat.resize(n);
+		qualified.resize(n);
+		has_minor.resize(n);
+		significant.resize(n);
+	}
+	size_t capacity() const { return site.size(); }
+	bool full() const { return num_sites == site.size(); }
+
+	// Copy the parsed values of site from over site to
+	void copy_site(size_t from, size_t to)
+	{
+		scaffold[to] = scaffold[from];
+		ref_nuc[to] = ref_nuc[from];
+		site[to] = site[from];
+		std::copy_n(&n1[from*num_pops], num_pops, &n1[to*num_pops]);
+		std::copy_n(&n2[from*num_pops], num_pops, &n2[to*num_pops]);
+		std::copy_n(&cov[from*num_pops], num_pops, &cov[to*num_pops]);
+		std::copy_n(&Nc[from*num_pops], num_pops, &Nc[to*num_pops]);
+		std::copy_n(&p[from*num_pops], num_pops, &p[to*num_pops]);
+		std::copy_n(&q[from*num_pops], num_pops, &q[to*num_pops]);
+		std::copy_n(&pol_llstat[from*num_pops], num_pops, &pol_llstat[to*num_pops]);
+	}
+};
+
+const size_t SITE_BATCH_SIZE = 256;	// number of sites analyzed together
+
+// Private allele found at a site of a batch
+struct PrivateAlleleRecord {
+	size_t site_index;	// index of the site in the batch
+	int tot_cov;		// total coverage
+	int ne_pops;		// number of populations with data
+	int num_alleles;	// number of alleles at the site
+	unsigned char allele;	// code of the private allele
+	int id_pop;		// id of the population with the private allele
+	double focal_paf;	// private-allele frequency in the focal population
+	double total_paf;	// private-allele frequency in the total population
+	double log_prob_pa;	// logarithm of the probability of the private allele
+	double maf_total;	// minor allele frequency in the total population
+};
+
+// Counters of the analysis with one combination of settings
+struct AnalysisCounters {
+	uint64_t sites_analyzed;	// sites with data in two or more populations (ne_pops >= 2)
+	uint64_t pops_below_min_Nc;	// populations with data at a site, but with Nc below min_Nc
+	uint64_t alleles_by_pol_test;	// alleles added by a minor allele passing the polymorphism test (pol_llstat > cv)
+	uint64_t private_alleles;	// private alleles written out
+	uint64_t log_cache_lookups;	// lookups of log(1-p) in LogTermCache, one per private allele
+	uint64_t log_q_hits;		// lookups found in the cache
+};
+
+// Direct-mapped cache of log(1-p), the term of log_prob_kernel that depends only on the frequency p.  The GFE
+// estimates of Nc and the mean frequencies derived from them take a limited set of values, so the same
+// frequencies recur across the private alleles of a run.  A cached term is the value computed on the miss,
+// so the results do not depend on the cache.
+struct LogTermCache {
+	static const int SLOT_BITS = 10;
+	std::vector <uint64_t> q_key;		// bits of p
+	std::vector <double> log_q;		// log(1-p)
+
+	LogTermCache() : q_key(1 << SLOT_BITS, ~(uint64_t)0), log_q(1 << SLOT_BITS) {}	// the keys start as a NaN that no estimate has
+
+	static size_t slot(uint64_t key) { return (size_t)( (key*0x9E3779B97F4A7C15ull) >> (64 - SLOT_BITS) ); }
+};
+
+// Working storage of compute_batch, reused across batches.  Each thread keeps its own copy.
+struct ComputeScratch {
+	std::vector <PrivateAlleleRecord> records;	// private alleles of the batch
+	std::vector <double> pa_freq, pa_Nc_focal, pa_Nc_other, pa_log_q, pa_log_prob;	// inputs and results of log_prob_kernel
+	std::vector <size_t> miss_index;	// private alleles whose log(1-p) is not in log_cache
+	std::vector <double> miss_p, miss_log_q;	// their frequencies and log(1-p)
+	LogTermCache log_cache;		// log(1-p) kept across batches
+
+	// A site has at most one private allele of each code, so with room for NUM_ALLELE_CODES per site
+	// compute_batch does not allocate for batches of up to num_sites sites
+	void reserve(size_t num_sites)
+	{
+		size_t n = num_sites*NUM_ALLELE_CODES;
+		records.reserve(n);
+		pa_freq.reserve(n);
+		pa_Nc_focal.reserve(n);
+		pa_Nc_other.reserve(n);
+		pa_log_q.reserve(n);
+		pa_log_prob.reserve(n);
+		miss_index.reserve(n);
+		miss_p.reserve(n);
+		miss_log_q.reserve(n);
+	}
+};
+
+// Compute log(1-p) of each frequency
+inline void log_q_kernel(size_t n, const double *p, double *log_q)
+{
+	FPA_SIMD_LOOP
+	for (size_t ig = 0; ig < n; ig++) {
+		log_q[ig] = log1p(-p[ig]);
+	}
+}
+
+// Fill log_q with log(1-p) of each frequency: from the cache where it has the frequency, else with
+// log_q_kernel over the frequencies missing, which are then added to the cache.  The lookups are done here
+// so that the loop of log_prob_kernel has no branches on the cache.
+inline void lookup_log_q(size_t n, const double *p, double *log_q, ComputeScratch &sc, AnalysisCounters &counts)
+{
+	LogTermCache &cache = sc.log_cache;
+	sc.miss_index.clear();
+	sc.miss_p.clear();
+	for (size_t ig = 0; ig < n; ig++) {
+		uint64_t p_bits;
+		memcpy(&p_bits, &p[ig], 8);
+		size_t q_slot = LogTermCache::slot(p_bits);
+		if (cache.q_key[q_slot] == p_bits) {
+			log_q[ig] = cache.log_q[q_slot];
+		} else {
+			sc.miss_index.push_back(ig);
+			sc.miss_p.push_back(p[ig]);
+		}
+	}
+	size_t num_misses = sc.miss_p.size();
+	sc.miss_log_q.resize(num_misses);
+	log_q_kernel(num_misses, sc.miss_p.data(), sc.miss_log_q.data());
+	for (size_t mg = 0; mg < num_misses; mg++) {
+		uint64_t p_bits;
+		memcpy(&p_bits, &sc.miss_p[mg], 8);
+		size_t q_slot = LogTermCache::slot(p_bits);
+		cache.q_key[q_slot] = p_bits;
+		cache.log_q[q_slot] = sc.miss_log_q[mg];
+		log_q[ sc.miss_index[mg] ] = sc.miss_log_q[mg];
+	}
+	counts.log_cache_lookups += n;
+	counts.log_q_hits += n - num_misses;
+}
+
+// Compute the common logarithm of the probability of finding each private allele,
+// (1-(1-p)^Nc_focal)*(1-p)^Nc_other, where p is the frequency of the allele in the total population,
+// from log_q = log(1-p) (see lookup_log_q).  The probability is evaluated in log space with log1p/expm1,
+// so it stays accurate and finite where the direct formula with pow() loses precision in subnormal
+// numbers (log10 below about -307.6) and then underflows to -inf.  Above that range the two agree to
+// about 1e-12, i.e. the %f output is the same up to rounding of the last digit.
+inline void log_prob_kernel(size_t n, const double *log_q, const double *Nc_focal, const double *Nc_other, double *log_prob)
+{
+	FPA_SIMD_LOOP
+	for (size_t ig = 0; ig < n; ig++) {
+		double log_q_focal = Nc_focal[ig]*log_q[ig];	// log((1-p)^Nc_focal) <= 0
+		// log(1-exp(x)), choosing the form that keeps precision for x near 0 and for very negative x.  libmvec
+		// has no masked variants, so the vector loop evaluates both forms and selects one.
+#ifdef FPA_VECTOR_MATH
+		double log_found_near = log(-expm1(log_q_focal)), log_found_far = log1p(-exp(log_q_focal));
+		double log_found = (log_q_focal > -M_LN2) ? log_found_near : log_found_far;	// log(1-(1-p)^Nc_focal)
+#else
+		double log_found = (log_q_focal > -M_LN2) ? log(-expm1(log_q_focal)) : log1p(-exp(log_q_focal));	// log(1-(1-p)^Nc_focal)
+#endif
+		double log_absent = (Nc_other[ig] > 0.0) ? Nc_other[ig]*log_q[ig] : 0.0;	// log((1-p)^Nc_other)
+		log_prob[ig] = (log_found + log_absent)/M_LN10;
+	}
+}
+
+// Find the private alleles of the sites of a batch, store them in sc.records and add to the counters.
+// The population filters are evaluated over the whole batch at once.  Then a single pass over the
+// populations of each site finds the alleles and accumulates, for every allele code, the number of
+// populations carrying it, the sum of its frequencies and the first population carrying it.
+inline void compute_batch(SiteBatch &batch, const FPAConfig &config, ComputeScratch &sc, AnalysisCounters &counts)
+{
+	const int num_pops = config.num_pops;
+	const double min_Nc = config.min_Nc;
+	const double cv = config.cv;
+	const size_t num_values = batch.num_sites*num_pops;
+	const unsigned char *n1 = batch.n1.data(), *n2 = batch.n2.data();
+	const int *pop_id = config.columns.pop_id.data();	// id of each population in the input
+	const double *Nc = batch.Nc.data(), *pol_llstat = batch.pol_llstat.data();
+	unsigned char *qualified = batch.qualified.data(), *has_minor = batch.has_minor.data(), *significant = batch.significant.data();
+	std::vector <PrivateAlleleRecord> &records = sc.records;
+	int num_alleles;
+	unsigned char alleles[NUM_ALLELE_CODES];	// store allele codes in the order they are found
+	unsigned int allele_mask;	// set of the alleles found, one bit per allele code
+	int num_pops_a[NUM_ALLELE_CODES];	// number of populations that have an allele
+	int first_pop_a[NUM_ALLELE_CODES];	// index of the first population with an allele
+	double freq_a[NUM_ALLELE_CODES];	// frequency of the allele in that population
+	double sum_freq_a[NUM_ALLELE_CODES];	// sum of the frequencies of the allele over populations with data
+	int tot_cov;		// total coverage (sum of the coverage across the populations)
+	int ne_pops;            // total number of populations with data
+	double sum_Nc;		// Sum of the effective number of sampled chromosomes over populations with data
+	int ag;		// allele counter
+	int k;		// population counter (population id - 1)
+	double mean_freq_a;           // mean of the frequencies of the allele over populations with data
+	double maf_total;		// minor allele frequency in the total population
+	double Nc_focal;		// effective number of sampled chromosomes in the focal population
+	size_t first_pa;		// index of the first record of the site
+	PrivateAlleleRecord record;
+	uint64_t num_below_min_Nc = 0, num_analyzed = 0, num_by_pol_test = 0;
+
+	// Examine a population only when there are ML estimates with Nc equal to or greater than the specified value at the site.
+	// The minor allele of such a population counts for it whenever the allele is found at the site, but adds a new allele
+	// only when it passes the polymorphism test.
+	for (size_t ig = 0; ig < num_values; ig++) {
+		qualified[ig] = (n1[ig] != ALLELE_NA) & (Nc[ig] >= min_Nc);
+		num_below_min_Nc += (n1[ig] != ALLELE_NA) & !qualified[ig];
+	}
+	for (size_t ig = 0; ig < num_values; ig++) {
+		has_minor[ig] = qualified[ig] & (n2[ig] != ALLELE_NA) & (n2[ig] != n1[ig]);
+	}
+	for (size_t ig = 0; ig < num_values; ig++) {
+		significant[ig] = has_minor[ig] & (pol_llstat[ig] > cv);
+	}
+
+	records.clear();
+	sc.pa_freq.clear();
+	sc.pa_Nc_focal.clear();
+	sc.pa_Nc_other.clear();
+	for (size_t sg = 0; sg < batch.num_sites; sg++) {
+		const size_t row = sg*num_pops;
+		const unsigned char *s_n1 = n1 + row, *s_n2 = n2 + row;
+		const unsigned char *s_qualified = qualified + row, *s_has_minor = has_minor + row, *s_significant = significant + row;
+		const int *s_cov = batch.cov.data() + row;
+		const double *s_Nc = Nc + row, *s_p = batch.p.data() + row, *s_q = batch.q.data() + row;
+
+		tot_cov = 0;
+		ne_pops = 0;
+		for (k = 0; k < num_pops; k++) {
+			tot_cov = tot_cov + s_cov[k];
+			ne_pops = ne_pops + s_qualified[k];
+		}
+		if (ne_pops == 0) {	// no alleles at the site
+			continue;
+		}
+		num_analyzed += (ne_pops >= 2);
+		sum_Nc = 0.0;	// summed in population order, as the frequencies below
+		for (k = 0; k < num_pops; k++) {
+			sum_Nc = sum_Nc + (s_qualified[k] ? s_Nc[k] : 0.0);
+		}
+
+		num_alleles = 0;
+		allele_mask = 0;
+		for (ag = 0; ag < NUM_ALLELE_CODES; ag++) {
+			num_pops_a[ag] = 0;
+			sum_freq_a[ag] = 0.0;
+		}
+		for (k = 0; k < num_pops; k++) {
+			if (!s_qualified[k]) {
+				continue;
+			}
+			unsigned char a1 = s_n1[k];
+			if ( !(allele_mask & (1u << a1)) ) {
+				allele_mask |= 1u << a1;
+				alleles[num_alleles++] = a1;
+			}
+			if (num_pops_a[a1]++ == 0) {
+				first_pop_a[a1] = k;
+				freq_a[a1] = s_p[k];
+			}
+			sum_freq_a[a1] = sum_freq_a[a1] + s_p[k];
+			if (s_has_minor[k]) {
+				unsigned char a2 = s_n2[k];
+				if ( s_significant[k] && !(allele_mask & (1u << a2)) ) {
+					allele_mask |= 1u << a2;
+					alleles[num_alleles++] = a2;
+					num_by_pol_test++;
+				}
+				if (num_pops_a[a2]++ == 0) {
+					first_pop_a[a2] = k;
+					freq_a[a2] = s_q[k];
+				}
+				sum_freq_a[a2] = sum_freq_a[a2] + s_q[k];
+			}
+		}
+		// num_alleles now counts the alleles segregating in the population sample
+		first_pa = records.size();
+		maf_total = 0.0;
+		for (ag = 0; ag < num_alleles; ag++) {		// Examine each of the alleles
+			unsigned char allele = alleles[ag];
+			mean_freq_a = sum_freq_a[allele]/ne_pops;
+			if (ag == 0) {
+				maf_total = mean_freq_a;
+			} else {
+				if (mean_freq_a < maf_total) {
+					maf_total = mean_freq_a;
+				}
+			}
+			if (ne_pops >= 2 && num_pops_a[allele] == 1) {		// private allele
+				record.site_index = sg;
+				record.tot_cov = tot_cov;
+				record.ne_pops = ne_pops;
+				record.num_alleles = num_alleles;
+				record.allele = allele;
+				record.id_pop = pop_id[first_pop_a[allele]];
+				record.focal_paf = freq_a[allele];
+				record.total_paf = mean_freq_a;
+				records.push_back(record);
+				Nc_focal = s_Nc[first_pop_a[allele]];
+				sc.pa_freq.push_back(mean_freq_a);
+				sc.pa_Nc_focal.push_back(Nc_focal);
+				sc.pa_Nc_other.push_back(sum_Nc - Nc_focal);
+			}
+		}
+		for (size_t rg = first_pa; rg < records.size(); rg++) {	// the MAF is known once all alleles are examined
+			records[rg].maf_total = maf_total;
+		}
+	}
+
+	// Probabilities of the private alleles of the whole batch
+	sc.pa_log_q.resize( records.size() );
+	sc.pa_log_prob.resize( records.size() );
+	lookup_log_q(records.size(), sc.pa_freq.data(), sc.pa_log_q.data(), sc, counts);
+	log_prob_kernel(records.size(), sc.pa_log_q.data(), sc.pa_Nc_focal.data(), sc.pa_Nc_other.data(), sc.pa_log_prob.data());
+	for (size_t rg = 0; rg < records.size(); rg++) {
+		records[rg].log_prob_pa = sc.pa_log_prob[rg];
+	}
+	counts.sites_analyzed += num_analyzed;
+	counts.pops_below_min_Nc += num_below_min_Nc;
+	counts.alleles_by_pol_test += num_by_pol_test;
+	counts.private_alleles += records.size();
+}
+
+// Estimates of one population at a site, i.e. the used GFE columns in numerical form
+struct PopulationEstimates {
+	unsigned char n1, n2;	// codes of the major and minor alleles (allele_code), ALLELE_NA when missing
+	int cov;		// population coverage
+	double Nc;		// effective number of sampled chromosomes
+	double p, q;		// ML estimates of the major- and minor-allele frequencies
+	double pol_llstat;	// statistic of the polymorphism test
+};
+
+// A site with the estimates of every population of the analysis, in population order
+struct SiteRecord {
+	std::string scaffold;
+	int site;
+	std::string ref_nuc;
+	std::vector <PopulationEstimates> pops;
+};
+
+// Settings of an analysis of num_pops populations, numbered from 1 in id_pop of the results
+inline FPAConfig fpa_config(int num_pops, double min_Nc, double cv)
+{
+	FPAConfig config = {};
+	config.num_pops = num_pops;
+	config.columns = gfe_column_map(num_pops);
+	config.min_Nc = min_Nc;
+	config.cv = cv;
+	config.reject_sites = false;
+	config.use_region = false;
+	return config;
+}
+
+// Find the private alleles of the given sites.  The site_index of each result is the index of its site in
+// sites; results are in the order of the sites, and of the alleles within a site as in the output of FPA.cpp.
+// Counts of the analysis are added to counts when it is not NULL.
+inline std::vector <PrivateAlleleRecord> process_batch(const std::vector <SiteRecord> &sites, const FPAConfig &config, AnalysisCounters *counts = NULL)
+{
+	const int num_pops = config.num_pops;
+	std::vector <PrivateAlleleRecord> results;
+	SiteBatch batch;
+	batch.init(num_pops, SITE_BATCH_SIZE);
+	ComputeScratch sc;
+	sc.reserve(SITE_BATCH_SIZE);
+	AnalysisCounters batch_counts = {};
+	for (size_t first = 0; first < sites.size(); first += SITE_BATCH_SIZE) {
+		batch.num_sites = std::min(SITE_BATCH_SIZE, sites.size() - first);
+		for (size_t sg = 0; sg < batch.num_sites; sg++) {
+			const SiteRecord &rec = sites[first + sg];
+			batch.scaffold[sg] = rec.scaffold;
+			batch.site[sg] = rec.site;
+			batch.ref_nuc[sg] = rec.ref_nuc;
+			for (int k = 0; k < num_pops; k++) {
+				const PopulationEstimates &pop = rec.pops[k];
+				size_t ig = sg*num_pops + k;
+				batch.n1[ig] = pop.n1;
+				batch.n2[ig] = pop.n2;
+				batch.cov[ig] = pop.cov;
+				batch.Nc[ig] = pop.Nc;
+				batch.p[ig] = pop.p;
+				batch.q[ig] = pop.q;
+				batch.pol_llstat[ig] = pop.pol_llstat;
+			}
+		}
+		compute_batch(batch, config, sc, batch_counts);
+		for (size_t rg = 0; rg < sc.records.size(); rg++) {
+			results.push_back(sc.records[rg]);
+			results.back().site_index += first;
+		}
+	}
+	if (counts != NULL) {
+		counts->sites_analyzed += batch_counts.sites_analyzed;
+		counts->pops_below_min_Nc += batch_counts.pops_below_min_Nc;
+		counts->alleles_by_pol_test += batch_counts.alleles_by_pol_test;
+		counts->private_alleles += batch_counts.private_alleles;
+		counts->log_cache_lookups += batch_counts.log_cache_lookups;
+		counts->log_q_hits += batch_counts.log_q_hits;
+	}
+	return results;
+}
+
+#endif // FPA_CORE_H